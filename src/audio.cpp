@@ -1,3 +1,7 @@
+#include <chrono>
+#include <cmath>
+#include <map>
+#include <mutex>
 #include <thread>
 
 #include <opus/opus_multistream.h>
@@ -88,13 +92,194 @@ namespace audio {
 
   auto control_shared = safe::make_shared<audio_ctx_t>(start_audio_control, stop_audio_control);
 
+  /**
+   * Keeps the audio sent to a client in step with the clock of the host.
+   *
+   * Every packet advances the RTP timestamp by exactly packetDuration, even when the source runs slightly fast or slow.
+   * Over a long session, the difference piles up in the playback queue of the client or drains it.
+   * The offset between the audio captured and the time passed since capture started is smoothed.
+   * Once it leaves the dead band, each packet is resampled from one sample frame more or less until the offset is close to zero again.
+   */
+  class drift_t {
+  public:
+    drift_t(int channels, int frame_size, std::int32_t sample_rate):
+        channels { channels }, frame_size { frame_size }, sample_rate { sample_rate } {
+      auto packet = std::chrono::duration<double>(frame_size) / sample_rate;
+
+      dead_band = std::max(2 * packet, std::chrono::duration<double>(5ms));
+      resync_threshold = 200ms;
+    }
+
+    /**
+     * Add a packet as captured
+     */
+    void
+    push(const std::vector<std::int16_t> &samples) {
+      auto now = std::chrono::steady_clock::now();
+      auto frames = (std::int64_t) samples.size() / channels;
+
+      pending.insert(std::end(pending), std::begin(samples), std::end(samples));
+      frames_in += frames;
+
+      if (!synced) {
+        // The first packet was recorded during the time it covers
+        start = now - std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(frames) / sample_rate);
+        frames_at_start = frames_in - frames;
+        corrected_at_start = dropped - inserted;
+        smoothed = {};
+        adjust = 0;
+        synced = true;
+
+        return;
+      }
+
+      auto elapsed = std::chrono::duration<double>(now - start);
+      auto captured = std::chrono::duration<double>(frames_in - frames_at_start) / sample_rate;
+      auto corrected = std::chrono::duration<double>(dropped - inserted - corrected_at_start) / sample_rate;
+
+      // How far the audio sent to the client runs ahead (positive) or behind (negative) the clock of the host
+      auto offset = captured - corrected - elapsed;
+
+      // A stalled source can't be made up for one sample frame at a time
+      if (std::chrono::abs(offset) > resync_threshold) {
+        BOOST_LOG(debug) << "Audio clock resync after an offset of "sv << offset.count() * 1000 << " ms"sv;
+
+        ++resyncs;
+        synced = false;
+        return;
+      }
+
+      smoothed += (offset - smoothed) / 64;
+
+      if (!adjust && std::chrono::abs(smoothed) > dead_band) {
+        adjust = smoothed.count() > 0 ? 1 : -1;
+      }
+      else if (adjust && adjust * smoothed.count() < dead_band.count() / 4) {
+        adjust = 0;
+      }
+
+      // The drift of the source itself, since the last resync
+      drift_ppm = (captured - elapsed) / elapsed * 1000000;
+    }
+
+    /**
+     * Take the next packet of frame_size sample frames
+     * return false if there isn't enough audio yet
+     */
+    bool
+    pop(std::vector<std::int16_t> &samples) {
+      // Drop or insert one sample frame by stretching this packet
+      auto frames = frame_size + adjust;
+      if (pending.size() < (std::size_t) frames * channels) {
+        return false;
+      }
+
+      samples.resize(frame_size * channels);
+      if (frames == frame_size) {
+        std::copy_n(std::begin(pending), samples.size(), std::begin(samples));
+      }
+      else {
+        auto step = (double) (frames - 1) / (frame_size - 1);
+        for (int x = 0; x < frame_size; ++x) {
+          auto pos = x * step;
+          auto frame = std::min((int) pos, frames - 2);
+          auto weight = pos - frame;
+
+          auto first = &pending[frame * channels];
+          auto second = first + channels;
+          for (int c = 0; c < channels; ++c) {
+            samples[x * channels + c] = (std::int16_t) std::lround(first[c] + (second[c] - first[c]) * weight);
+          }
+        }
+
+        if (adjust > 0) {
+          ++dropped;
+        }
+        else {
+          ++inserted;
+        }
+      }
+
+      pending.erase(std::begin(pending), std::begin(pending) + frames * channels);
+      return true;
+    }
+
+    ~drift_t() {
+      BOOST_LOG(info) << "Audio clock drift: "sv << drift_ppm << " ppm, "sv
+                      << dropped << " sample frames dropped, "sv << inserted << " inserted, "sv
+                      << resyncs << " resyncs"sv;
+    }
+
+  private:
+    int channels;
+    int frame_size;
+    std::int32_t sample_rate;
+
+    std::chrono::duration<double> dead_band;
+    std::chrono::duration<double> resync_threshold;
+
+    std::vector<std::int16_t> pending;
+
+    std::chrono::steady_clock::time_point start;
+    std::chrono::duration<double> smoothed {};
+
+    // 1 to drop a sample frame from each packet, -1 to insert one
+    int adjust = 0;
+
+    bool synced = false;
+    std::int64_t frames_at_start = 0;
+    std::int64_t corrected_at_start = 0;
+
+    std::int64_t frames_in = 0;
+    std::int64_t dropped = 0;
+    std::int64_t inserted = 0;
+    std::int64_t resyncs = 0;
+
+    double drift_ppm = 0;
+  };
+
+  /**
+   * Audio is captured and encoded once for all sessions that ask for the same stream and packet duration.
+   * Every session gets a copy of the encoded packets and encrypts and sends them on its own.
+   */
+  struct capture_group_t {
+    struct subscriber_t {
+      safe::mail_raw_t::queue_t<packet_t> packets;
+      void *channel_data;
+    };
+
+    // Stream configuration and packet duration
+    using stream_key_t = std::pair<int, int>;
+
+    stream_key_t key;
+    config_t config;
+
+    std::mutex lock;
+    std::vector<subscriber_t> subscribers;
+
+    std::atomic_bool stop { false };
+    std::thread thread;
+
+    void
+    raise(const buffer_t &packet) {
+      std::lock_guard lg { lock };
+      for (auto &subscriber : subscribers) {
+        subscriber.packets->raise(subscriber.channel_data, packet);
+      }
+    }
+  };
+
+  static std::mutex groups_lock;
+  static std::map<capture_group_t::stream_key_t, std::shared_ptr<capture_group_t>> groups;
+
   void
-  encodeThread(sample_queue_t samples, config_t config, void *channel_data) {
-    auto packets = mail::man->queue<packet_t>(mail::audio_packets);
-    auto stream = &stream_configs[map_stream(config.channels, config.flags[config_t::HIGH_QUALITY])];
+  encodeThread(std::shared_ptr<capture_group_t> group, sample_queue_t samples) {
+    auto &config = group->config;
+    auto stream = &stream_configs[group->key.first];
 
     // Encoding takes place on this thread
     platf::adjust_thread_priority(platf::thread_priority_e::high);
+    platf::adjust_thread_affinity(platf::thread_role_e::audio);
 
     opus_t opus { opus_multistream_encoder_create(
       stream->sampleRate,
@@ -115,20 +300,106 @@ namespace audio {
       int bytes = opus_multistream_encode(opus.get(), sample->data(), frame_size, std::begin(packet), packet.size());
       if (bytes < 0) {
         BOOST_LOG(error) << "Couldn't encode audio: "sv << opus_strerror(bytes);
-        packets->stop();
+
+        // Sessions that start from now on need a new capture
+        std::lock_guard lg { groups_lock };
+        auto it = groups.find(group->key);
+        if (it != std::end(groups) && it->second == group) {
+          groups.erase(it);
+        }
+
+        group->stop = true;
+
+        std::lock_guard group_lg { group->lock };
+        for (auto &subscriber : group->subscribers) {
+          subscriber.packets->stop();
+        }
 
         return;
       }
 
       packet.fake_resize(bytes);
-      packets->raise(channel_data, std::move(packet));
+      group->raise(packet);
+    }
+  }
+
+  void
+  captureThread(std::shared_ptr<capture_group_t> group) {
+    auto &config = group->config;
+    auto stream = &stream_configs[group->key.first];
+
+    // The sessions of this group hold a reference as well
+    auto ref = control_shared.ref();
+    auto &control = ref->control;
+
+    // Capture takes place on this thread
+    platf::adjust_thread_priority(platf::thread_priority_e::critical);
+    platf::adjust_thread_affinity(platf::thread_role_e::audio);
+
+    auto samples = std::make_shared<sample_queue_t::element_type>(30);
+    std::thread thread { encodeThread, group, samples };
+
+    auto fg = util::fail_guard([&]() {
+      samples->stop();
+      thread.join();
+
+      // Sessions that start from now on need a new capture
+      std::lock_guard lg { groups_lock };
+      auto it = groups.find(group->key);
+      if (it != std::end(groups) && it->second == group) {
+        groups.erase(it);
+      }
+    });
+
+    auto frame_size = config.packetDuration * stream->sampleRate / 1000;
+    int samples_per_frame = frame_size * stream->channelCount;
+
+    auto mic = control->microphone(stream->mapping, stream->channelCount, stream->sampleRate, frame_size);
+    if (!mic) {
+      BOOST_LOG(error) << "Couldn't create audio input"sv;
+
+      return;
+    }
+
+    drift_t drift { stream->channelCount, frame_size, stream->sampleRate };
+
+    std::vector<std::int16_t> sample_buffer;
+    while (!group->stop) {
+      sample_buffer.resize(samples_per_frame);
+
+      auto status = mic->sample(sample_buffer);
+      switch (status) {
+        case platf::capture_e::ok:
+          break;
+        case platf::capture_e::timeout:
+          continue;
+        case platf::capture_e::reinit:
+          mic.reset();
+          mic = control->microphone(stream->mapping, stream->channelCount, stream->sampleRate, frame_size);
+          if (!mic) {
+            BOOST_LOG(error) << "Couldn't re-initialize audio input"sv;
+
+            return;
+          }
+          return;
+        default:
+          return;
+      }
+
+      drift.push(sample_buffer);
+
+      std::vector<std::int16_t> packet;
+      while (drift.pop(packet)) {
+        samples->raise(std::move(packet));
+      }
     }
   }
 
   void
   capture(safe::mail_t mail, config_t config, void *channel_data) {
     auto shutdown_event = mail->event<bool>(mail::shutdown);
-    auto stream = &stream_configs[map_stream(config.channels, config.flags[config_t::HIGH_QUALITY])];
+    auto stream_index = map_stream(config.channels, config.flags[config_t::HIGH_QUALITY]);
+    auto stream = &stream_configs[stream_index];
 
     auto ref = control_shared.ref();
     if (!ref) {
@@ -181,54 +452,55 @@ namespace audio {
       }
     }
 
-    // Capture takes place on this thread
-    platf::adjust_thread_priority(platf::thread_priority_e::critical);
-
-    auto samples = std::make_shared<sample_queue_t::element_type>(30);
-    std::thread thread { encodeThread, samples, config, channel_data };
-
-    auto fg = util::fail_guard([&]() {
-      samples->stop();
-      thread.join();
-
-      shutdown_event->view();
-    });
+    std::shared_ptr<capture_group_t> group;
+    {
+      std::lock_guard lg { groups_lock };
+
+      capture_group_t::stream_key_t key { stream_index, config.packetDuration };
+      auto &entry = groups[key];
+      if (!entry) {
+        entry = std::make_shared<capture_group_t>();
+        entry->key = key;
+        entry->config = config;
+        entry->thread = std::thread { captureThread, entry };
+      }
+      group = entry;
 
-    auto frame_size = config.packetDuration * stream->sampleRate / 1000;
-    int samples_per_frame = frame_size * stream->channelCount;
+      std::lock_guard group_lg { group->lock };
+      group->subscribers.push_back({ mail->queue<packet_t>(mail::audio_packets), channel_data });
 
-    auto mic = control->microphone(stream->mapping, stream->channelCount, stream->sampleRate, frame_size);
-    if (!mic) {
-      BOOST_LOG(error) << "Couldn't create audio input"sv;
-
-      return;
+      BOOST_LOG(debug) << "Audio capture shared by "sv << group->subscribers.size() << " session(s)"sv;
     }
 
-    while (!shutdown_event->peek()) {
-      std::vector<std::int16_t> sample_buffer;
-      sample_buffer.resize(samples_per_frame);
-
-      auto status = mic->sample(sample_buffer);
-      switch (status) {
-        case platf::capture_e::ok:
-          break;
-        case platf::capture_e::timeout:
-          continue;
-        case platf::capture_e::reinit:
-          mic.reset();
-          mic = control->microphone(stream->mapping, stream->channelCount, stream->sampleRate, frame_size);
-          if (!mic) {
-            BOOST_LOG(error) << "Couldn't re-initialize audio input"sv;
-
-            return;
+    auto fg = util::fail_guard([&]() {
+      bool last;
+      {
+        std::lock_guard lg { groups_lock };
+        std::lock_guard group_lg { group->lock };
+
+        auto &subscribers = group->subscribers;
+        subscribers.erase(std::remove_if(std::begin(subscribers), std::end(subscribers), [channel_data](auto &subscriber) {
+          return subscriber.channel_data == channel_data;
+        }),
+          std::end(subscribers));
+
+        last = subscribers.empty();
+        if (last) {
+          group->stop = true;
+
+          auto it = groups.find(group->key);
+          if (it != std::end(groups) && it->second == group) {
+            groups.erase(it);
           }
-          return;
-        default:
-          return;
+        }
       }
 
-      samples->raise(std::move(sample_buffer));
-    }
+      if (last) {
+        group->thread.join();
+      }
+    });
+
+    shutdown_event->view();
   }
 
   int
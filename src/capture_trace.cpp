@@ -0,0 +1,420 @@
+/**
+ * @file capture_trace.cpp
+ */
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <thread>
+
+#include "capture_trace.h"
+#include "main.h"
+#include "platform/common.h"
+#include "thread_safe.h"
+
+using namespace std::literals;
+namespace capture_trace {
+  constexpr char magic[8] { 'S', 'U', 'N', 'T', 'R', 'A', 'C', 'E' };
+
+  // Frames copied by the capture thread that haven't been written yet
+  constexpr int max_frames_in_flight = 4;
+
+  // A raw frame is written regularly, so a replay never depends on a long chain of deltas
+  constexpr int keyframe_interval = 120;
+
+  /**
+   * A delta payload is a sequence of runs over the 32-bit words of the frame.
+   * Each run_t is followed by the copy words that changed.
+   * Words past the last run are unchanged.
+   */
+  struct run_t {
+    std::uint32_t skip;
+    std::uint32_t copy;
+  };
+
+  struct frame_t {
+    std::int64_t timestamp;
+
+    std::int32_t width;
+    std::int32_t height;
+    std::int32_t pixel_pitch;
+    std::int32_t row_pitch;
+
+    std::vector<std::uint8_t> data;
+  };
+
+  bool
+  is_trace(const void *data, std::size_t size) {
+    return size >= sizeof(file_header_t) && !std::memcmp(data, magic, sizeof(magic));
+  }
+
+  int
+  apply_delta(const std::uint8_t *payload, std::size_t payload_size, const std::uint8_t *prev, std::uint8_t *out, std::size_t frame_size) {
+    auto payload_end = payload + payload_size;
+
+    std::size_t pos = 0;
+    while (payload < payload_end) {
+      run_t run;
+      if ((std::size_t) (payload_end - payload) < sizeof(run)) {
+        return -1;
+      }
+      std::memcpy(&run, payload, sizeof(run));
+      payload += sizeof(run);
+
+      auto skip = (std::size_t) run.skip * 4;
+      auto copy = (std::size_t) run.copy * 4;
+      if (pos + skip + copy > frame_size || (std::size_t) (payload_end - payload) < copy) {
+        return -1;
+      }
+
+      if (prev != out) {
+        std::memcpy(out + pos, prev + pos, skip);
+      }
+      pos += skip;
+
+      std::memcpy(out + pos, payload, copy);
+      payload += copy;
+      pos += copy;
+    }
+
+    if (prev != out) {
+      std::memcpy(out + pos, prev + pos, frame_size - pos);
+    }
+
+    return 0;
+  }
+
+  int
+  delta_damage(const std::uint8_t *payload, std::size_t payload_size, int width, int height, int row_pitch, std::vector<platf::rect_t> &damage) {
+    // Bands are cut at this height, so a diagonal change doesn't turn into a single rectangle over the whole frame
+    constexpr int max_band_height = 64;
+
+    damage.clear();
+    if (width <= 0 || height <= 0 || row_pitch < width * 4) {
+      return -1;
+    }
+
+    // The changed columns of each row, [first, second)
+    std::vector<std::pair<int, int>> columns(height, { width, 0 });
+
+    auto payload_end = payload + payload_size;
+    auto frame_size = (std::size_t) row_pitch * height;
+
+    std::size_t pos = 0;
+    while (payload < payload_end) {
+      run_t run;
+      if ((std::size_t) (payload_end - payload) < sizeof(run)) {
+        return -1;
+      }
+      std::memcpy(&run, payload, sizeof(run));
+      payload += sizeof(run);
+
+      auto skip = (std::size_t) run.skip * 4;
+      auto copy = (std::size_t) run.copy * 4;
+      if (pos + skip + copy > frame_size || (std::size_t) (payload_end - payload) < copy) {
+        return -1;
+      }
+      payload += copy;
+      pos += skip;
+
+      auto end = pos + copy;
+      for (auto y = pos / row_pitch; copy && y <= (end - 1) / row_pitch; ++y) {
+        auto row_begin = y * row_pitch;
+
+        // The padding past the last pixel of a row isn't part of the image
+        auto x_begin = (int) ((std::max(pos, row_begin) - row_begin) / 4);
+        auto x_end = (int) ((std::min(end, row_begin + row_pitch) - row_begin + 3) / 4);
+        x_end = std::min(x_end, width);
+
+        if (x_begin < x_end) {
+          columns[y].first = std::min(columns[y].first, x_begin);
+          columns[y].second = std::max(columns[y].second, x_end);
+        }
+      }
+
+      pos = end;
+    }
+
+    for (int y = 0; y < height;) {
+      if (columns[y].first >= columns[y].second) {
+        ++y;
+        continue;
+      }
+
+      auto rect = platf::rect_t { columns[y].first, y, 0, 0 };
+      auto x_end = columns[y].second;
+
+      auto y_begin = y;
+      for (; y < height && y - y_begin < max_band_height && columns[y].first < columns[y].second; ++y) {
+        rect.x = std::min(rect.x, columns[y].first);
+        x_end = std::max(x_end, columns[y].second);
+      }
+
+      rect.width = x_end - rect.x;
+      rect.height = y - y_begin;
+      damage.emplace_back(rect);
+    }
+
+    return 0;
+  }
+
+  /**
+   * return false if the delta wouldn't be smaller than the frame itself
+   */
+  static bool
+  encode_delta(const std::uint8_t *prev_p, const std::uint8_t *cur_p, std::size_t frame_size, std::vector<std::uint8_t> &out) {
+    auto prev = (const std::uint32_t *) prev_p;
+    auto cur = (const std::uint32_t *) cur_p;
+    auto words = frame_size / 4;
+
+    out.clear();
+
+    std::size_t x = 0;
+    while (x < words) {
+      auto skip_begin = x;
+      while (x < words && prev[x] == cur[x]) {
+        ++x;
+      }
+
+      if (x == words) {
+        break;
+      }
+
+      // A run costs two words, so single unchanged words are cheaper to copy
+      auto copy_begin = x;
+      while (x < words && (prev[x] != cur[x] || (x + 1 < words && prev[x + 1] != cur[x + 1]))) {
+        ++x;
+      }
+
+      run_t run { (std::uint32_t) (copy_begin - skip_begin), (std::uint32_t) (x - copy_begin) };
+
+      auto size = out.size();
+      if (size + sizeof(run) + run.copy * 4 >= frame_size) {
+        return false;
+      }
+
+      out.resize(size + sizeof(run) + run.copy * 4);
+      std::memcpy(out.data() + size, &run, sizeof(run));
+      std::memcpy(out.data() + size + sizeof(run), cur + copy_begin, run.copy * 4);
+    }
+
+    return true;
+  }
+
+  class file_recorder_t: public recorder_t {
+  public:
+    file_recorder_t():
+        queue { max_frames_in_flight + 1 } {}
+
+    int
+    init(const std::string &path, bool delta) {
+      file.open(path, std::ios::binary | std::ios::trunc);
+      if (!file) {
+        BOOST_LOG(error) << "Couldn't open capture trace ["sv << path << ']';
+        return -1;
+      }
+
+      this->delta = delta;
+
+      file_header_t header {};
+      std::copy(std::begin(magic), std::end(magic), header.magic);
+      header.version = version;
+      write(&header, sizeof(header));
+
+      thread = std::thread { &file_recorder_t::writeThread, this };
+
+      BOOST_LOG(info) << "Recording captured frames to ["sv << path << ']';
+      return 0;
+    }
+
+    void
+    record(const platf::img_t &img) override {
+      if (!img.data) {
+        if (!warned_no_data) {
+          BOOST_LOG(warning) << "Captured frames aren't in system memory, they can't be recorded"sv;
+          warned_no_data = true;
+        }
+
+        return;
+      }
+
+      auto now = std::chrono::steady_clock::now();
+      if (!start) {
+        start = now;
+      }
+
+      std::vector<std::uint8_t> buffer;
+      {
+        std::lock_guard lg { pool_lock };
+
+        if (in_flight == max_frames_in_flight) {
+          ++dropped;
+          return;
+        }
+
+        if (!pool.empty()) {
+          buffer = std::move(pool.back());
+          pool.pop_back();
+        }
+
+        ++in_flight;
+      }
+
+      buffer.assign(img.data, img.data + (std::size_t) img.row_pitch * img.height);
+
+      queue.raise(frame_t {
+        std::chrono::duration_cast<std::chrono::nanoseconds>(now - *start).count(),
+        img.width,
+        img.height,
+        img.pixel_pitch,
+        img.row_pitch,
+        std::move(buffer),
+      });
+    }
+
+    ~file_recorder_t() override {
+      if (!thread.joinable()) {
+        return;
+      }
+
+      queue.stop();
+      thread.join();
+
+      // The writer thread is gone, the frames still in the queue can be written from here
+      for (auto &frame : queue.unsafe()) {
+        write_frame(frame);
+      }
+
+      file_header_t header {};
+      std::copy(std::begin(magic), std::end(magic), header.magic);
+      header.version = version;
+      header.frame_count = index.size();
+      header.index_offset = offset;
+
+      write(index.data(), index.size() * sizeof(std::uint64_t));
+
+      file.seekp(0);
+      file.write((const char *) &header, sizeof(header));
+      file.close();
+
+      if (failed || !file) {
+        BOOST_LOG(error) << "Capture trace is incomplete"sv;
+      }
+
+      BOOST_LOG(info) << "Capture trace: recorded "sv << index.size() << " frames, dropped "sv << dropped;
+    }
+
+  private:
+    void
+    writeThread() {
+      while (auto frame = queue.pop()) {
+        write_frame(*frame);
+      }
+    }
+
+    void
+    write_frame(frame_t &frame) {
+      auto frame_size = frame.data.size();
+
+      bool use_delta =
+        delta &&
+        frame_nr % keyframe_interval != 0 &&
+        frame_size % 4 == 0 &&
+        prev.data.size() == frame_size &&
+        prev.width == frame.width && prev.height == frame.height && prev.row_pitch == frame.row_pitch &&
+        encode_delta(prev.data.data(), frame.data.data(), frame_size, delta_buf);
+
+      frame_header_t header {
+        frame.timestamp,
+        frame.width,
+        frame.height,
+        frame.pixel_pitch,
+        frame.row_pitch,
+        use_delta ? encoding_e::delta : encoding_e::raw,
+        0,
+        0,
+        use_delta ? delta_buf.size() : frame_size,
+      };
+
+      pad(alignof(frame_header_t));
+      auto header_offset = offset;
+
+      header.payload_offset = header_offset + sizeof(header);
+      if (!use_delta) {
+        header.payload_offset = (header.payload_offset + page_size - 1) / page_size * page_size;
+      }
+
+      write(&header, sizeof(header));
+      pad(use_delta ? 1 : page_size);
+
+      if (use_delta) {
+        write(delta_buf.data(), delta_buf.size());
+      }
+      else {
+        write(frame.data.data(), frame_size);
+      }
+
+      index.emplace_back(header_offset);
+      ++frame_nr;
+
+      // The previous frame's buffer goes back to the capture thread
+      std::swap(prev, frame);
+
+      std::lock_guard lg { pool_lock };
+      pool.emplace_back(std::move(frame.data));
+      --in_flight;
+    }
+
+    void
+    write(const void *data, std::size_t size) {
+      file.write((const char *) data, size);
+      offset += size;
+
+      if (!file && !failed) {
+        BOOST_LOG(error) << "Couldn't write to capture trace"sv;
+        failed = true;
+      }
+    }
+
+    void
+    pad(std::size_t alignment) {
+      static const std::vector<char> zeroes(page_size);
+
+      auto padding = (alignment - offset % alignment) % alignment;
+      write(zeroes.data(), padding);
+    }
+
+    std::ofstream file;
+    std::uint64_t offset {};
+    bool failed {};
+
+    bool delta;
+    std::vector<std::uint8_t> delta_buf;
+    frame_t prev {};
+    std::uint64_t frame_nr {};
+
+    std::vector<std::uint64_t> index;
+
+    // Only touched by the capture thread
+    std::optional<std::chrono::steady_clock::time_point> start;
+    bool warned_no_data {};
+
+    std::mutex pool_lock;
+    std::vector<std::vector<std::uint8_t>> pool;
+    int in_flight {};
+    std::uint64_t dropped {};
+
+    safe::queue_t<frame_t> queue;
+    std::thread thread;
+  };
+
+  std::unique_ptr<recorder_t>
+  make_recorder(const std::string &path, bool delta) {
+    auto recorder = std::make_unique<file_recorder_t>();
+
+    if (recorder->init(path, delta)) {
+      return nullptr;
+    }
+
+    return recorder;
+  }
+}  // namespace capture_trace
@@ -0,0 +1,104 @@
+/**
+ * @file capture_trace.h
+ */
+#ifndef SUNSHINE_CAPTURE_TRACE_H
+#define SUNSHINE_CAPTURE_TRACE_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace platf {
+  struct img_t;
+  struct rect_t;
+}
+
+/**
+ * Recording of the frames produced by the capture thread.
+ * This allows reproducing performance issues on real content, without running the game.
+ *
+ * Layout of a trace:
+ *   file_header_t
+ *   for each frame: frame_header_t followed by its payload
+ *   index: file_header_t::frame_count offsets to the frame headers
+ *
+ * Raw payloads are page aligned, so a replay can use them straight from a memory mapping.
+ * The header is rewritten when the trace is closed, an index_offset of 0 means the trace was cut short.
+ */
+namespace capture_trace {
+  constexpr std::uint32_t version = 1;
+  constexpr std::uint32_t page_size = 4096;
+
+  enum class encoding_e : std::uint32_t {
+    raw,  // row_pitch * height bytes
+    delta,  // Differences against the previous frame in the trace, see apply_delta()
+  };
+
+  struct file_header_t {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t reserved;
+    std::uint64_t frame_count;
+    std::uint64_t index_offset;
+  };
+
+  struct frame_header_t {
+    // Nanoseconds since the first frame
+    std::int64_t timestamp;
+
+    std::int32_t width;
+    std::int32_t height;
+    std::int32_t pixel_pitch;
+    std::int32_t row_pitch;
+
+    encoding_e encoding;
+    std::uint32_t reserved;
+
+    // Relative to the start of the file
+    std::uint64_t payload_offset;
+    std::uint64_t payload_size;
+  };
+
+  /**
+   * Check whether the mapped file starts like a trace.
+   */
+  bool
+  is_trace(const void *data, std::size_t size);
+
+  /**
+   * Rebuild a frame from a delta payload.
+   *
+   * prev <-- The previous frame in the trace, may be the same as out
+   * out <-- Destination, frame_size bytes
+   * return -1 if the payload is malformed
+   */
+  int
+  apply_delta(const std::uint8_t *payload, std::size_t payload_size, const std::uint8_t *prev, std::uint8_t *out, std::size_t frame_size);
+
+  /**
+   * The regions of the frame a delta payload changes, one rectangle per band of consecutive changed rows.
+   *
+   * damage <-- Cleared, then filled with the rectangles
+   * return -1 if the payload is malformed
+   */
+  int
+  delta_damage(const std::uint8_t *payload, std::size_t payload_size, int width, int height, int row_pitch, std::vector<platf::rect_t> &damage);
+
+  class recorder_t {
+  public:
+    /**
+     * Copy the image and queue it for writing.
+     * Frames are dropped rather than stalling the capture thread when the disk can't keep up.
+     */
+    virtual void
+    record(const platf::img_t &img) = 0;
+
+    virtual ~recorder_t() = default;
+  };
+
+  std::unique_ptr<recorder_t>
+  make_recorder(const std::string &path, bool delta);
+}  // namespace capture_trace
+
+#endif
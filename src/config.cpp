@@ -331,6 +331,10 @@ namespace config {
     0,  // hevc_mode
 
     1,  // min_threads
+
+    0,  // convert_threads
+    "balanced"s,  // convert_quality
+
     {
       "superfast"s,  // preset
       "zerolatency"s,  // tune
@@ -368,10 +372,17 @@ namespace config {
     },  // vt
 
     {},  // capture
+    {},  // capture_file
+    {},  // capture_trace
+    true,  // capture_trace_delta
     {},  // encoder
+    "encoder_cache.json"s,  // encoder_cache
     {},  // adapter_name
     {},  // output_name
-    true  // dwmflush
+    true,  // dwmflush
+
+    false,  // shared_encoding
+    false,  // dynamic_resolution
   };
 
   audio_t audio {};
@@ -382,7 +393,11 @@ namespace config {
     APPS_JSON_PATH,
 
     20,  // fecPercentage
-    1  // channels
+    1,  // channels
+    1,  // video_workers
+
+    false,  // io_uring
+    0,  // zerocopy_threshold
   };
 
   nvhttp_t nvhttp {
@@ -443,6 +458,8 @@ namespace config {
     47989,
     platf::appdata().string() + "/sunshine.log",  // log file
     {},  // prep commands
+    "other"s,  // thread_scheduler
+    {},  // cpu_affinity
   };
 
   bool
@@ -851,6 +868,44 @@ namespace config {
     }
   }
 
+  /**
+   * A list of CPUs in the format of taskset, e.g. 0-3,8
+   */
+  void
+  cpu_list_f(std::unordered_map<std::string, std::string> &vars, const std::string &name, std::vector<int> &input) {
+    std::string tmp;
+    string_f(vars, name, tmp);
+
+    auto is_number = [](std::string_view val) {
+      return !val.empty() && std::all_of(std::begin(val), std::end(val), [](char ch) { return std::isdigit(ch); });
+    };
+
+    std::vector<int> cpus;
+    std::string_view list = tmp;
+    while (!list.empty()) {
+      auto end = list.find(',');
+      auto range = list.substr(0, end);
+      list = end == std::string_view::npos ? std::string_view {} : list.substr(end + 1);
+
+      auto dash = range.find('-');
+      auto first = range.substr(0, dash);
+      auto last = dash == std::string_view::npos ? first : range.substr(dash + 1);
+
+      if (!is_number(first) || !is_number(last)) {
+        std::cout << "Warning: ["sv << name << "] is not a valid list of CPUs --> "sv << tmp << std::endl;
+        return;
+      }
+
+      for (int cpu = util::from_view(first); cpu <= util::from_view(last); ++cpu) {
+        cpus.emplace_back(cpu);
+      }
+    }
+
+    if (!cpus.empty()) {
+      input = std::move(cpus);
+    }
+  }
+
   void
   map_int_int_f(std::unordered_map<std::string, std::string> &vars, const std::string &name, std::unordered_map<int, int> &input) {
     std::vector<int> list;
@@ -911,6 +966,8 @@ namespace config {
 
     int_f(vars, "qp", video.qp);
     int_f(vars, "min_threads", video.min_threads);
+    int_between_f(vars, "convert_threads", video.convert_threads, { 0, 64 });
+    string_restricted_f(vars, "convert_quality", video.convert_quality, { "fast"sv, "balanced"sv, "quality"sv });
     int_between_f(vars, "hevc_mode", video.hevc_mode, { 0, 3 });
     string_f(vars, "sw_preset", video.sw.sw_preset);
     string_f(vars, "sw_tune", video.sw.sw_tune);
@@ -953,10 +1010,23 @@ namespace config {
     int_f(vars, "vt_realtime", video.vt.vt_realtime, vt::rt_from_view);
 
     string_f(vars, "capture", video.capture);
+    // An empty capture_file selects the test pattern, it mustn't become the appdata directory
+    string_f(vars, "capture_file", video.capture_file);
+    if (!video.capture_file.empty()) {
+      path_f(vars, "capture_file", video.capture_file);
+    }
+    string_f(vars, "capture_trace", video.capture_trace);
+    if (!video.capture_trace.empty()) {
+      path_f(vars, "capture_trace", video.capture_trace);
+    }
+    bool_f(vars, "capture_trace_delta", video.capture_trace_delta);
     string_f(vars, "encoder", video.encoder);
+    path_f(vars, "encoder_cache", video.encoder_cache);
     string_f(vars, "adapter_name", video.adapter_name);
     string_f(vars, "output_name", video.output_name);
     bool_f(vars, "dwmflush", video.dwmflush);
+    bool_f(vars, "shared_encoding", video.shared_encoding);
+    bool_f(vars, "dynamic_resolution", video.dynamic_resolution);
 
     path_f(vars, "pkey", nvhttp.pkey);
     path_f(vars, "cert", nvhttp.cert);
@@ -986,9 +1056,12 @@ namespace config {
     }
 
     int_between_f(vars, "channels", stream.channels, { 1, std::numeric_limits<int>::max() });
+    int_between_f(vars, "video_workers", stream.video_workers, { 1, 16 });
 
     path_f(vars, "file_apps", stream.file_apps);
     int_between_f(vars, "fec_percentage", stream.fec_percentage, { 1, 255 });
+    bool_f(vars, "io_uring", stream.io_uring);
+    int_between_f(vars, "zerocopy_threshold", stream.zerocopy_threshold, { 0, std::numeric_limits<int>::max() });
 
     map_int_int_f(vars, "keybindings"s, input.keybindings);
 
@@ -1027,6 +1100,14 @@ namespace config {
     bool_f(vars, "keyboard", input.keyboard);
     bool_f(vars, "controller", input.controller);
 
+    string_restricted_f(vars, "thread_scheduler", sunshine.thread_scheduler, { "other"sv, "fifo"sv, "rr"sv });
+    cpu_list_f(vars, "capture_cpus", sunshine.cpu_affinity.capture);
+    cpu_list_f(vars, "encode_cpus", sunshine.cpu_affinity.encode);
+    cpu_list_f(vars, "video_send_cpus", sunshine.cpu_affinity.video_send);
+    cpu_list_f(vars, "audio_cpus", sunshine.cpu_affinity.audio);
+    cpu_list_f(vars, "control_cpus", sunshine.cpu_affinity.control);
+    cpu_list_f(vars, "input_cpus", sunshine.cpu_affinity.input);
+
     int port = sunshine.port;
     int_f(vars, "port"s, port);
     sunshine.port = (std::uint16_t) port;
@@ -1086,6 +1167,29 @@ namespace config {
     }
   }
 
+  const std::vector<int> &
+  cpu_affinity(platf::thread_role_e role) {
+    static const std::vector<int> any_cpu;
+
+    switch (role) {
+      case platf::thread_role_e::capture:
+        return sunshine.cpu_affinity.capture;
+      case platf::thread_role_e::encode:
+        return sunshine.cpu_affinity.encode;
+      case platf::thread_role_e::video_send:
+        return sunshine.cpu_affinity.video_send;
+      case platf::thread_role_e::audio:
+        return sunshine.cpu_affinity.audio;
+      case platf::thread_role_e::control:
+        return sunshine.cpu_affinity.control;
+      case platf::thread_role_e::input:
+        return sunshine.cpu_affinity.input;
+    }
+
+    BOOST_LOG(error) << "Unknown thread role: "sv << (int) role;
+    return any_cpu;
+  }
+
   int
   parse(int argc, char *argv[]) {
     std::unordered_map<std::string, std::string> cmd_vars;
@@ -8,6 +8,10 @@
 #include <unordered_map>
 #include <vector>
 
+namespace platf {
+  enum class thread_role_e : int;
+}  // namespace platf
+
 namespace config {
   struct video_t {
     // ffmpeg params
@@ -16,6 +20,9 @@ namespace config {
     int hevc_mode;
 
     int min_threads;  // Minimum number of threads/slices for CPU encoding
+
+    int convert_threads;  // Number of bands a frame in system memory is split into for colour conversion, 0 --> automatic
+    std::string convert_quality;  // fast, balanced or quality
     struct {
       std::string sw_preset;
       std::string sw_tune;
@@ -53,10 +60,17 @@ namespace config {
     } vt;
 
     std::string capture;
+    std::string capture_file;  // Raw frames replayed by the synthetic capture
+    std::string capture_trace;  // Record captured frames to this file
+    bool capture_trace_delta;
     std::string encoder;
+    std::string encoder_cache;  // Capabilities of the encoders found by previous validations
     std::string adapter_name;
     std::string output_name;
     bool dwmflush;
+
+    bool shared_encoding;  // Sessions with identical stream settings share a single encoder
+    bool dynamic_resolution;  // Lower the resolution while the encoder can't keep up with the framerate
   };
 
   struct audio_t {
@@ -73,6 +87,12 @@ namespace config {
 
     // max unique instances of video and audio streams
     int channels;
+
+    // number of threads sending video, each with its own socket
+    int video_workers;
+
+    bool io_uring;  // Send the video through io_uring on Linux, undocumented until it beats sendmsg() with UDP_SEGMENT
+    int zerocopy_threshold;  // Frames of at least this many bytes are sent with MSG_ZEROCOPY on Linux, 0 disables it
   };
 
   struct nvhttp_t {
@@ -148,6 +168,18 @@ namespace config {
     std::string log_file;
 
     std::vector<prep_cmd_t> prep_cmds;
+
+    std::string thread_scheduler;  // other, fifo or rr: the scheduling policy of the high priority threads
+
+    // The CPUs each kind of thread may run on, empty --> any CPU
+    struct {
+      std::vector<int> capture;
+      std::vector<int> encode;
+      std::vector<int> video_send;
+      std::vector<int> audio;
+      std::vector<int> control;
+      std::vector<int> input;
+    } cpu_affinity;
   };
 
   extern video_t video;
@@ -157,6 +189,12 @@ namespace config {
   extern input_t input;
   extern sunshine_t sunshine;
 
+  /**
+   * The CPUs the threads of a role may run on, empty --> any CPU
+   */
+  const std::vector<int> &
+  cpu_affinity(platf::thread_role_e role);
+
   int
   parse(int argc, char *argv[]);
   std::unordered_map<std::string, std::string>
@@ -0,0 +1,157 @@
+/**
+ * @file frame_hash.cpp
+ */
+#include <algorithm>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+  #include <immintrin.h>
+#elif defined(__ARM_NEON)
+  #include <arm_neon.h>
+#endif
+
+#include "frame_hash.h"
+#include "platform/common.h"
+
+namespace frame_hash {
+  // The primes of xxHash32
+  constexpr std::uint32_t prime1 = 2654435761u;
+  constexpr std::uint32_t prime2 = 2246822519u;
+  constexpr std::uint32_t prime3 = 3266489917u;
+  constexpr std::uint64_t prime64 = 0x9E3779B185EBCA87ull;
+
+  // Independent accumulators, one per 32-bit word of a 64 bytes block
+  constexpr int lanes = 16;
+  constexpr std::size_t block_size = lanes * 4;
+
+  /**
+   * Every step is a bijection, so changing a single word always changes the accumulator
+   */
+  static inline std::uint32_t
+  round(std::uint32_t acc, std::uint32_t word) {
+    acc += word * prime2;
+    acc = (acc << 13) | (acc >> 19);
+
+    return acc * prime1;
+  }
+
+  using blocks_t = void (*)(std::uint32_t *acc, const std::uint8_t *data, std::size_t blocks);
+
+  static void
+  blocks_scalar(std::uint32_t *acc, const std::uint8_t *data, std::size_t blocks) {
+    for (std::size_t x = 0; x < blocks; ++x, data += block_size) {
+      for (int lane = 0; lane < lanes; ++lane) {
+        std::uint32_t word;
+        std::memcpy(&word, data + lane * 4, sizeof(word));
+
+        acc[lane] = round(acc[lane], word);
+      }
+    }
+  }
+
+#if defined(__x86_64__) || defined(__i386__)
+  __attribute__((target("avx2"))) static inline __m256i
+  round_avx2(__m256i acc, __m256i word) {
+    acc = _mm256_add_epi32(acc, _mm256_mullo_epi32(word, _mm256_set1_epi32(prime2)));
+    acc = _mm256_or_si256(_mm256_slli_epi32(acc, 13), _mm256_srli_epi32(acc, 19));
+
+    return _mm256_mullo_epi32(acc, _mm256_set1_epi32(prime1));
+  }
+
+  __attribute__((target("avx2"))) static void
+  blocks_avx2(std::uint32_t *acc, const std::uint8_t *data, std::size_t blocks) {
+    auto acc_lo = _mm256_loadu_si256((const __m256i *) acc);
+    auto acc_hi = _mm256_loadu_si256((const __m256i *) (acc + 8));
+
+    for (std::size_t x = 0; x < blocks; ++x, data += block_size) {
+      acc_lo = round_avx2(acc_lo, _mm256_loadu_si256((const __m256i *) data));
+      acc_hi = round_avx2(acc_hi, _mm256_loadu_si256((const __m256i *) (data + 32)));
+    }
+
+    _mm256_storeu_si256((__m256i *) acc, acc_lo);
+    _mm256_storeu_si256((__m256i *) (acc + 8), acc_hi);
+  }
+#elif defined(__ARM_NEON)
+  static inline uint32x4_t
+  round_neon(uint32x4_t acc, uint32x4_t word) {
+    acc = vmlaq_n_u32(acc, word, prime2);
+    acc = vsriq_n_u32(vshlq_n_u32(acc, 13), acc, 19);
+
+    return vmulq_n_u32(acc, prime1);
+  }
+
+  static void
+  blocks_neon(std::uint32_t *acc, const std::uint8_t *data, std::size_t blocks) {
+    uint32x4_t v[4];
+    for (int x = 0; x < 4; ++x) {
+      v[x] = vld1q_u32(acc + x * 4);
+    }
+
+    for (std::size_t x = 0; x < blocks; ++x, data += block_size) {
+      for (int y = 0; y < 4; ++y) {
+        v[y] = round_neon(v[y], vreinterpretq_u32_u8(vld1q_u8(data + y * 16)));
+      }
+    }
+
+    for (int x = 0; x < 4; ++x) {
+      vst1q_u32(acc + x * 4, v[x]);
+    }
+  }
+#endif
+
+  static blocks_t
+  select_blocks() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+      return blocks_avx2;
+    }
+#elif defined(__ARM_NEON)
+    return blocks_neon;
+#endif
+
+    return blocks_scalar;
+  }
+
+  std::uint64_t
+  hash(const platf::img_t &img) {
+    static const auto blocks = select_blocks();
+
+    std::uint32_t acc[lanes];
+    for (int lane = 0; lane < lanes; ++lane) {
+      acc[lane] = prime1 * (lane + 1) + ((std::uint32_t) img.width ^ ((std::uint32_t) img.height << 16));
+    }
+
+    auto row_size = (std::size_t) img.width * img.pixel_pitch;
+    auto block_bytes = row_size / block_size * block_size;
+
+    for (int y = 0; y < img.height; ++y) {
+      auto row = img.data + (std::size_t) y * img.row_pitch;
+
+      blocks(acc, row, row_size / block_size);
+
+      int lane = 0;
+      for (auto x = block_bytes; x < row_size; x += 4) {
+        std::uint32_t word {};
+        std::memcpy(&word, row + x, std::min<std::size_t>(sizeof(word), row_size - x));
+
+        acc[lane] = round(acc[lane], word);
+        ++lane;
+      }
+    }
+
+    std::uint64_t hash = 0;
+    for (auto value : acc) {
+      // Final avalanche of xxHash32
+      value ^= value >> 15;
+      value *= prime2;
+      value ^= value >> 13;
+      value *= prime3;
+      value ^= value >> 16;
+
+      hash = (hash ^ value) * prime64;
+    }
+
+    return hash;
+  }
+}  // namespace frame_hash
@@ -0,0 +1,26 @@
+/**
+ * @file frame_hash.h
+ */
+#ifndef SUNSHINE_FRAME_HASH_H
+#define SUNSHINE_FRAME_HASH_H
+
+#include <cstdint>
+
+namespace platf {
+  struct img_t;
+}
+
+/**
+ * Fast, non-cryptographic hash of the content of captured images.
+ * It's used to recognize an image identical to the previous one, without keeping a copy of the previous one.
+ */
+namespace frame_hash {
+  /**
+   * Hash the visible pixels of an image in system memory, the padding at the end of each row is ignored.
+   * The dimensions are part of the hash.
+   */
+  std::uint64_t
+  hash(const platf::img_t &img);
+}  // namespace frame_hash
+
+#endif
@@ -748,6 +748,11 @@ namespace input {
   init() {
     platf_input = platf::input();
 
+    // Input is injected from the task pool, the other tasks share its CPUs
+    task_pool.push([]() {
+      platf::adjust_thread_affinity(platf::thread_role_e::input);
+    });
+
     return std::make_unique<deinit_t>();
   }
 
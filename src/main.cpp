@@ -356,9 +356,9 @@ main(int argc, char *argv[]) {
 
   reed_solomon_init();
   auto input_deinit_guard = input::init();
-  if (video::init()) {
-    BOOST_LOG(error) << "Video failed to initialize"sv;
-  }
+
+  // Probing the encoders takes a while, only launching a stream has to wait for it
+  video::init_async();
 
   if (http::init()) {
     BOOST_LOG(error) << "http failed to initialize"sv;
@@ -29,6 +29,7 @@
 #include "rtsp.h"
 #include "utility.h"
 #include "uuid.h"
+#include "video.h"
 
 using namespace std::literals;
 namespace nvhttp {
@@ -610,6 +611,9 @@ namespace nvhttp {
 
     auto local_endpoint = request->local_endpoint();
 
+    // The supported codecs are only known once the encoders are probed
+    video::wait_for_init();
+
     pt::ptree tree;
 
     tree.put("root.<xmlattr>.status_code", 200);
@@ -705,6 +709,9 @@ namespace nvhttp {
       return;
     }
 
+    // HDR support is only known once the encoders are probed
+    video::wait_for_init();
+
     auto &apps = tree.add_child("root", pt::ptree {});
 
     apps.put("<xmlattr>.status_code", 200);
@@ -752,6 +759,14 @@ namespace nvhttp {
       return;
     }
 
+    // The encoders may still be probed
+    if (video::wait_for_init()) {
+      tree.put("root.<xmlattr>.status_code", 503);
+      tree.put("root.gamesession", 0);
+
+      return;
+    }
+
     auto appid = util::from_view(get_arg(args, "appid"));
 
     auto current_appid = proc::proc.running();
@@ -10,6 +10,7 @@
 #include <functional>
 #include <mutex>
 #include <string>
+#include <vector>
 
 #include "src/main.h"
 #include "src/thread_safe.h"
@@ -169,6 +170,13 @@ namespace platf {
     virtual ~deinit_t() = default;
   };
 
+  struct rect_t {
+    std::int32_t x;
+    std::int32_t y;
+    std::int32_t width;
+    std::int32_t height;
+  };
+
   struct img_t {
   public:
     img_t() = default;
@@ -186,6 +194,16 @@ namespace platf {
     std::int32_t pixel_pitch {};
     std::int32_t row_pitch {};
 
+    // Regions known to have changed since the previous frame, such as the cursor.
+    // An empty list doesn't mean the frame is unchanged, only that nothing is known about it.
+    std::vector<rect_t> damage;
+
+    // Set by backends that track every change to the screen, not just the cursor they draw, such as the replay of a trace
+    bool damage_complete {};
+
+    // Identifies the captured frame held by the image, 0 if it isn't shared between sessions
+    std::uint64_t sequence {};
+
     virtual ~img_t() = default;
   };
 
@@ -367,6 +385,13 @@ namespace platf {
   std::vector<std::string>
   display_names(mem_type_e hwdevice_type);
 
+  /**
+   * The GPUs of the system, as stable across reboots as the platform allows.
+   * It changes when a GPU is added, removed or replaced, or its driver is updated where the platform reports that.
+   */
+  std::string
+  gpu_identity();
+
   boost::process::child
   run_unprivileged(const std::string &cmd, boost::filesystem::path &working_dir, boost::process::environment &env, FILE *file, std::error_code &ec, boost::process::group *group);
 
@@ -379,6 +404,18 @@ namespace platf {
   void
   adjust_thread_priority(thread_priority_e priority);
 
+  // The kinds of threads that can be pinned to a set of CPUs, see config::sunshine.cpu_affinity
+  enum class thread_role_e : int {
+    capture,
+    encode,
+    video_send,
+    audio,
+    control,
+    input
+  };
+  void
+  adjust_thread_affinity(thread_role_e role);
+
   // Allow OS-specific actions to be taken to prepare for streaming
   void
   streaming_will_start();
@@ -398,10 +435,40 @@ namespace platf {
     std::uintptr_t native_socket;
     boost::asio::ip::address &target_address;
     uint16_t target_port;
+
+    // If set, buffer may be sent without copying it.
+    // The platform holds on to owner until the kernel no longer reads buffer.
+    std::shared_ptr<void> owner;
   };
   bool
   send_batch(batched_send_info_t &send_info);
 
+  /**
+   * Datagrams of different sizes for the same target
+   */
+  struct multi_send_info_t {
+    const std::string_view *datagrams;
+    size_t datagram_count;
+
+    std::uintptr_t native_socket;
+    boost::asio::ip::address &target_address;
+    uint16_t target_port;
+  };
+  /**
+   * Send all datagrams with as few system calls as possible
+   * return false if that isn't supported, the caller has to send the datagrams one by one
+   */
+  bool
+  send_batch(multi_send_info_t &send_info);
+
+  /**
+   * The number of payload bytes on a socket the network stack hasn't sent yet
+   * datagram_size <-- The typical size of the datagrams sent on the socket
+   * return -1 if the platform can't tell
+   */
+  std::int64_t
+  send_queue_bytes(std::uintptr_t native_socket, std::size_t datagram_size);
+
   enum class qos_data_type_e : int {
     audio,
     video
@@ -2,13 +2,14 @@
 // Created by loki on 5/16/21.
 //
 #include <bitset>
+#include <condition_variable>
+#include <mutex>
 #include <sstream>
 
 #include <boost/regex.hpp>
 
 #include <pulse/error.h>
 #include <pulse/pulseaudio.h>
-#include <pulse/simple.h>
 
 #include "src/platform/common.h"
 
@@ -48,23 +49,298 @@ namespace platf {
     return result;
   }
 
+  /**
+   * Ring of samples with a single producer and a single consumer.
+   * Neither side takes a lock to move samples in or out.
+   */
+  class sample_ring_t {
+  public:
+    sample_ring_t(std::size_t min_capacity, std::size_t channels):
+        channels { channels } {
+      std::size_t capacity = 1;
+      while (capacity < min_capacity) {
+        capacity <<= 1;
+      }
+
+      buf.resize(capacity);
+    }
+
+    /**
+     * Append samples, data == nullptr appends silence.
+     * Only whole sample frames are appended, so the channels stay interleaved when the ring is full.
+     * return the number of samples that fit
+     */
+    std::size_t
+    write(const std::int16_t *data, std::size_t count) {
+      auto head = _head.load(std::memory_order_relaxed);
+      auto tail = _tail.load(std::memory_order_acquire);
+
+      count = std::min(count, buf.size() - (head - tail)) / channels * channels;
+      for (std::size_t x = 0; x < count; ++x) {
+        buf[(head + x) & (buf.size() - 1)] = data ? data[x] : 0;
+      }
+
+      _head.store(head + count, std::memory_order_release);
+      return count;
+    }
+
+    /**
+     * Take count samples, count may not exceed available()
+     */
+    void
+    read(std::int16_t *dest, std::size_t count) {
+      auto tail = _tail.load(std::memory_order_relaxed);
+      for (std::size_t x = 0; x < count; ++x) {
+        dest[x] = buf[(tail + x) & (buf.size() - 1)];
+      }
+
+      _tail.store(tail + count, std::memory_order_release);
+    }
+
+    std::size_t
+    available() const {
+      return _head.load(std::memory_order_acquire) - _tail.load(std::memory_order_acquire);
+    }
+
+  private:
+    std::vector<std::int16_t> buf;
+    std::size_t channels;
+
+    std::atomic<std::size_t> _head { 0 };
+    std::atomic<std::size_t> _tail { 0 };
+  };
+
+  /**
+   * Records through an asynchronous pa_stream on its own mainloop thread.
+   * The fragment size matches a single audio packet, so the server hands over each packet as soon as it's recorded.
+   * The read callback only copies the samples into a ring, sample() takes them out.
+   */
   struct mic_attr_t: public mic_t {
-    util::safe_ptr<pa_simple, pa_simple_free> mic;
+    using loop_t = util::safe_ptr<pa_threaded_mainloop, pa_threaded_mainloop_free>;
+    using ctx_t = util::safe_ptr<pa_context, pa_context_unref>;
+    using stream_t = util::safe_ptr<pa_stream, pa_stream_unref>;
+    using proplist_t = util::safe_ptr<pa_proplist, pa_proplist_free>;
+
+    loop_t loop;
+    ctx_t ctx;
+    stream_t stream;
+
+    std::unique_ptr<sample_ring_t> ring;
+    std::atomic_bool failed { false };
+
+    // Only used to sleep while the ring doesn't hold a full packet
+    std::mutex lock;
+    std::condition_variable cv;
+
+    std::uint32_t sample_rate;
+    int channels;
+
+    // Latency reported by the server for the latest fragment in microseconds
+    std::atomic<std::uint64_t> source_latency { 0 };
+
+    struct {
+      std::uint64_t frames = 0;
+      std::uint64_t latency_total = 0;
+      std::uint64_t latency_max = 0;
+      std::atomic<std::uint64_t> dropped { 0 };
+    } stats;
 
     capture_e
     sample(std::vector<std::int16_t> &sample_buf) override {
       auto sample_size = sample_buf.size();
 
-      auto buf = sample_buf.data();
-      int status;
-      if (pa_simple_read(mic.get(), buf, sample_size * 2, &status)) {
-        BOOST_LOG(error) << "pa_simple_read() failed: "sv << pa_strerror(status);
+      {
+        std::unique_lock ul { lock };
+        auto ready = cv.wait_for(ul, 100ms, [&]() {
+          return ring->available() >= sample_size || failed;
+        });
+
+        if (failed) {
+          return capture_e::error;
+        }
 
-        return capture_e::error;
+        if (!ready) {
+          return capture_e::timeout;
+        }
       }
 
+      ring->read(sample_buf.data(), sample_size);
+
+      // The packet is as old as the latency of the source plus everything recorded after it
+      auto latency = source_latency.load(std::memory_order_relaxed) +
+                     (std::uint64_t) ring->available() * 1000000 / channels / sample_rate;
+
+      ++stats.frames;
+      stats.latency_total += latency;
+      stats.latency_max = std::max(stats.latency_max, latency);
+
       return capture_e::ok;
     }
+
+    int
+    init(const pa_sample_spec &ss, const pa_channel_map &map, std::uint32_t frame_size, const std::string &source_name) {
+      sample_rate = ss.rate;
+      channels = ss.channels;
+
+      // Room for a few packets in case the encoder falls behind
+      ring = std::make_unique<sample_ring_t>(frame_size * channels * 8, channels);
+
+      loop.reset(pa_threaded_mainloop_new());
+      ctx.reset(pa_context_new(pa_threaded_mainloop_get_api(loop.get()), "sunshine"));
+
+      pa_context_set_state_callback(ctx.get(), context_state_cb, this);
+      if (pa_context_connect(ctx.get(), nullptr, PA_CONTEXT_NOFLAGS, nullptr) < 0) {
+        BOOST_LOG(error) << "Couldn't connect to pulseaudio: "sv << pa_strerror(pa_context_errno(ctx.get()));
+        return -1;
+      }
+
+      if (pa_threaded_mainloop_start(loop.get()) < 0) {
+        BOOST_LOG(error) << "Couldn't start pulseaudio main loop"sv;
+        return -1;
+      }
+
+      pa_threaded_mainloop_lock(loop.get());
+      auto fg = util::fail_guard([&]() {
+        pa_threaded_mainloop_unlock(loop.get());
+      });
+
+      for (auto state = pa_context_get_state(ctx.get()); state != PA_CONTEXT_READY; state = pa_context_get_state(ctx.get())) {
+        if (!PA_CONTEXT_IS_GOOD(state)) {
+          BOOST_LOG(error) << "Couldn't connect to pulseaudio: "sv << pa_strerror(pa_context_errno(ctx.get()));
+          return -1;
+        }
+
+        pa_threaded_mainloop_wait(loop.get());
+      }
+
+      // PipeWire sizes its quantum after node.latency, PulseAudio ignores it
+      proplist_t props { pa_proplist_new() };
+      pa_proplist_setf(props.get(), "node.latency", "%u/%u", frame_size, sample_rate);
+
+      stream.reset(pa_stream_new_with_proplist(ctx.get(), "sunshine-record", &ss, &map, props.get()));
+      if (!stream) {
+        BOOST_LOG(error) << "pa_stream_new_with_proplist() failed: "sv << pa_strerror(pa_context_errno(ctx.get()));
+        return -1;
+      }
+
+      pa_stream_set_state_callback(stream.get(), stream_state_cb, this);
+      pa_stream_set_read_callback(stream.get(), read_cb, this);
+
+      auto frame_bytes = frame_size * (std::uint32_t) pa_frame_size(&ss);
+
+      pa_buffer_attr pa_attr;
+      pa_attr.maxlength = frame_bytes * 8;
+      pa_attr.tlength = (std::uint32_t) -1;
+      pa_attr.prebuf = (std::uint32_t) -1;
+      pa_attr.minreq = (std::uint32_t) -1;
+      pa_attr.fragsize = frame_bytes;
+
+      auto flags = (pa_stream_flags_t) (PA_STREAM_ADJUST_LATENCY | PA_STREAM_AUTO_TIMING_UPDATE | PA_STREAM_INTERPOLATE_TIMING);
+      if (pa_stream_connect_record(stream.get(), source_name.c_str(), &pa_attr, flags) < 0) {
+        BOOST_LOG(error) << "pa_stream_connect_record() failed: "sv << pa_strerror(pa_context_errno(ctx.get()));
+        return -1;
+      }
+
+      for (auto state = pa_stream_get_state(stream.get()); state != PA_STREAM_READY; state = pa_stream_get_state(stream.get())) {
+        if (!PA_STREAM_IS_GOOD(state)) {
+          BOOST_LOG(error) << "Couldn't record from ["sv << source_name << "]: "sv << pa_strerror(pa_context_errno(ctx.get()));
+          return -1;
+        }
+
+        pa_threaded_mainloop_wait(loop.get());
+      }
+
+      auto attr = pa_stream_get_buffer_attr(stream.get());
+      BOOST_LOG(debug) << "Audio capture fragment size: "sv << attr->fragsize << " bytes, requested "sv << frame_bytes;
+
+      return 0;
+    }
+
+    ~mic_attr_t() override {
+      if (loop) {
+        pa_threaded_mainloop_stop(loop.get());
+      }
+
+      if (stream) {
+        pa_stream_disconnect(stream.get());
+        stream.reset();
+      }
+
+      if (ctx) {
+        pa_context_disconnect(ctx.get());
+        ctx.reset();
+      }
+
+      if (stats.frames) {
+        BOOST_LOG(info) << "Audio capture latency: average "sv << stats.latency_total / stats.frames / 1000.0
+                        << " ms, maximum "sv << stats.latency_max / 1000.0
+                        << " ms, "sv << stats.dropped.load() << " samples dropped"sv;
+      }
+    }
+
+  private:
+    void
+    wake() {
+      // Taking the lock orders the notification after the check in sample()
+      { std::lock_guard lg { lock }; }
+      cv.notify_one();
+    }
+
+    static void
+    context_state_cb(pa_context *ctx, void *userdata) {
+      auto mic = (mic_attr_t *) userdata;
+
+      pa_threaded_mainloop_signal(mic->loop.get(), 0);
+    }
+
+    static void
+    stream_state_cb(pa_stream *stream, void *userdata) {
+      auto mic = (mic_attr_t *) userdata;
+
+      if (!PA_STREAM_IS_GOOD(pa_stream_get_state(stream))) {
+        mic->failed = true;
+        mic->wake();
+      }
+
+      pa_threaded_mainloop_signal(mic->loop.get(), 0);
+    }
+
+    static void
+    read_cb(pa_stream *stream, size_t, void *userdata) {
+      auto mic = (mic_attr_t *) userdata;
+
+      while (pa_stream_readable_size(stream) > 0) {
+        const void *data;
+        size_t bytes;
+        if (pa_stream_peek(stream, &data, &bytes) < 0) {
+          BOOST_LOG(error) << "pa_stream_peek() failed: "sv << pa_strerror(pa_context_errno(pa_stream_get_context(stream)));
+
+          mic->failed = true;
+          break;
+        }
+
+        if (!bytes) {
+          break;
+        }
+
+        // data is nullptr for a hole in the stream, it's filled with silence
+        auto count = bytes / sizeof(std::int16_t);
+        auto written = mic->ring->write((const std::int16_t *) data, count);
+        if (written < count) {
+          mic->stats.dropped += count - written;
+        }
+
+        pa_stream_drop(stream);
+      }
+
+      pa_usec_t latency;
+      int negative;
+      if (!pa_stream_get_latency(stream, &latency, &negative)) {
+        mic->source_latency.store(negative ? 0 : latency, std::memory_order_relaxed);
+      }
+
+      mic->wake();
+    }
   };
 
   std::unique_ptr<mic_t>
@@ -79,19 +355,7 @@ namespace platf {
       channel = position_mapping[*mapping++];
     });
 
-    pa_buffer_attr pa_attr = {};
-    pa_attr.maxlength = frame_size * 8;
-
-    int status;
-
-    mic->mic.reset(
-      pa_simple_new(nullptr, "sunshine",
-        pa_stream_direction_t::PA_STREAM_RECORD, source_name.c_str(),
-        "sunshine-record", &ss, &pa_map, &pa_attr, &status));
-
-    if (!mic->mic) {
-      auto err_str = pa_strerror(status);
-      BOOST_LOG(error) << "pa_simple_new() failed: "sv << err_str;
+    if (mic->init(ss, pa_map, frame_size, source_name)) {
       return nullptr;
     }
 
@@ -794,6 +794,7 @@ namespace platf {
         BOOST_LOG(debug) << "width and height: w "sv << w << " h "sv << h;
 
         gl::ctx.GetTextureSubImage(rgb->tex[0], 0, img_offset_x, img_offset_y, 0, width, height, 1, GL_BGRA, GL_UNSIGNED_BYTE, img_out_base->height * img_out_base->row_pitch, img_out_base->data);
+        img_out_base->damage.clear();
 
         if (cursor_opt && cursor) {
           cursor_opt->blend(*img_out_base, img_offset_x, img_offset_y);
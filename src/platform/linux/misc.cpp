@@ -3,17 +3,28 @@
  */
 
 // standard includes
+#include <deque>
 #include <fstream>
 
 // lib includes
 #include <arpa/inet.h>
 #include <boost/asio/ip/address.hpp>
 #include <boost/process.hpp>
+#include <boost/process/extend.hpp>
 #include <dlfcn.h>
 #include <fcntl.h>
 #include <ifaddrs.h>
+#include <linux/errqueue.h>
+#include <linux/sock_diag.h>
+#include <linux/sockios.h>
 #include <netinet/udp.h>
+#include <pthread.h>
 #include <pwd.h>
+#include <sched.h>
+#include <signal.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
 #include <unistd.h>
 
 // local includes
@@ -22,6 +33,7 @@
 #include "src/config.h"
 #include "src/main.h"
 #include "src/platform/common.h"
+#include "uring.h"
 #include "vaapi.h"
 
 #ifdef __GNUC__
@@ -158,30 +170,345 @@ namespace platf {
     return "00:00:00:00:00:00"s;
   }
 
+  std::string
+  gpu_identity() {
+    std::vector<std::string> gpus;
+
+    std::error_code ec;
+    for (auto &entry : fs::directory_iterator { "/sys/class/drm", ec }) {
+      // Connectors are named after their card, e.g. card0-HDMI-A-1
+      auto name = entry.path().filename().string();
+      if (name.rfind("card"sv, 0) != 0 || name.find('-') != std::string::npos) {
+        continue;
+      }
+
+      auto device = entry.path() / "device";
+
+      // The PCI address, vendor, device and revision ids and the name of the driver
+      std::string gpu = fs::canonical(device, ec).filename().string();
+      for (auto file : { "vendor"sv, "device"sv, "revision"sv }) {
+        std::ifstream in { device / file };
+
+        std::string id;
+        std::getline(in, id);
+
+        gpu += ':';
+        gpu += id;
+      }
+
+      gpu += ':';
+      gpu += fs::canonical(device / "driver", ec).filename().string();
+
+      gpus.emplace_back(std::move(gpu));
+    }
+
+    // The order of the cards depends on the order the drivers were loaded in
+    std::sort(std::begin(gpus), std::end(gpus));
+
+    std::string identity;
+    for (auto &gpu : gpus) {
+      identity += gpu;
+      identity += ',';
+    }
+
+    return identity;
+  }
+
+  namespace rttime {
+    // The limit before rtkit required one, launched apps get it back where permitted
+    static rlimit original;
+    static std::atomic_bool lowered { false };
+
+    /**
+     * rtkit only grants real-time scheduling to processes that limit the CPU time of their real-time threads.
+     * A thread that doesn't block for longer than the soft limit gets SIGXCPU and falls back to SCHED_OTHER,
+     * only the hard limit kills the process.
+     */
+    static int
+    lower() {
+      static std::once_flag once;
+      static int result = -1;
+
+      std::call_once(once, []() {
+        if (getrlimit(RLIMIT_RTTIME, &original)) {
+          return;
+        }
+
+        struct sigaction action {};
+        action.sa_handler = [](int) {
+          // The signal goes to the thread that exceeded the limit
+          sched_param param {};
+          sched_setscheduler(0, SCHED_OTHER, &param);
+        };
+        sigemptyset(&action.sa_mask);
+        sigaction(SIGXCPU, &action, nullptr);
+
+        // rtkit's default maximum is 200 ms
+        rlimit limit { 100000, std::min<rlim_t>(200000, original.rlim_max) };
+        limit.rlim_cur = std::min(limit.rlim_cur, limit.rlim_max / 2);
+
+        result = setrlimit(RLIMIT_RTTIME, &limit);
+        lowered = !result;
+      });
+
+      return result;
+    }
+
+    /**
+     * Runs in the child between fork() and exec(), so it may only make async-signal-safe calls.
+     * Without CAP_SYS_RESOURCE the hard limit can't be raised again, the child keeps a soft limit below it then.
+     */
+    static void
+    restore() {
+      if (lowered) {
+        setrlimit(RLIMIT_RTTIME, &original);
+      }
+    }
+  }  // namespace rttime
+
   bp::child
   run_unprivileged(const std::string &cmd, boost::filesystem::path &working_dir, bp::environment &env, FILE *file, std::error_code &ec, bp::group *group) {
     BOOST_LOG(warning) << "run_unprivileged() is not yet implemented for this platform. The new process will run with Sunshine's permissions."sv;
+
+    // Apps don't need the limit on real-time CPU time rtkit asked Sunshine for
+    auto restore_rttime = bp::extend::on_exec_setup([](auto &) { rttime::restore(); });
+
     if (!group) {
       if (!file) {
-        return bp::child(cmd, env, bp::start_dir(working_dir), bp::std_out > bp::null, bp::std_err > bp::null, ec);
+        return bp::child(cmd, env, bp::start_dir(working_dir), bp::std_out > bp::null, bp::std_err > bp::null, ec, restore_rttime);
       }
       else {
-        return bp::child(cmd, env, bp::start_dir(working_dir), bp::std_out > file, bp::std_err > file, ec);
+        return bp::child(cmd, env, bp::start_dir(working_dir), bp::std_out > file, bp::std_err > file, ec, restore_rttime);
       }
     }
     else {
       if (!file) {
-        return bp::child(cmd, env, bp::start_dir(working_dir), bp::std_out > bp::null, bp::std_err > bp::null, ec, *group);
+        return bp::child(cmd, env, bp::start_dir(working_dir), bp::std_out > bp::null, bp::std_err > bp::null, ec, *group, restore_rttime);
       }
       else {
-        return bp::child(cmd, env, bp::start_dir(working_dir), bp::std_out > file, bp::std_err > file, ec, *group);
+        return bp::child(cmd, env, bp::start_dir(working_dir), bp::std_out > file, bp::std_err > file, ec, *group, restore_rttime);
       }
     }
   }
 
+  namespace rtkit {
+    // The parts of libdbus-1 needed to talk to rtkit, it's only loaded when needed
+    struct DBusConnection;
+    struct DBusMessage;
+
+    struct DBusError {
+      const char *name;
+      const char *message;
+
+      unsigned int dummy1 : 1;
+      unsigned int dummy2 : 1;
+      unsigned int dummy3 : 1;
+      unsigned int dummy4 : 1;
+      unsigned int dummy5 : 1;
+
+      void *padding1;
+    };
+
+    constexpr int DBUS_BUS_SYSTEM = 1;
+    constexpr int DBUS_TYPE_INVALID = 0;
+    constexpr int DBUS_TYPE_INT32 = 'i';
+    constexpr int DBUS_TYPE_UINT32 = 'u';
+    constexpr int DBUS_TYPE_UINT64 = 't';
+
+  #define _FN(x, ret, args)    \
+    typedef ret(*x##_fn) args; \
+    static x##_fn x
+
+    _FN(error_init, void, (DBusError * error));
+    _FN(error_free, void, (DBusError * error));
+    _FN(bus_get, DBusConnection *, (int type, DBusError *error));
+    _FN(connection_unref, void, (DBusConnection * connection));
+    _FN(message_new_method_call, DBusMessage *, (const char *destination, const char *path, const char *iface, const char *method));
+    _FN(message_append_args, std::uint32_t, (DBusMessage * message, int first_arg_type, ...));
+    _FN(connection_send_with_reply_and_block, DBusMessage *, (DBusConnection * connection, DBusMessage *message, int timeout_milliseconds, DBusError *error));
+    _FN(message_unref, void, (DBusMessage * message));
+
+  #undef _FN
+
+    static int
+    init() {
+      static void *handle { nullptr };
+      static bool funcs_loaded = false;
+
+      if (funcs_loaded) return 0;
+
+      if (!handle) {
+        handle = dyn::handle({ "libdbus-1.so.3", "libdbus-1.so" });
+        if (!handle) {
+          return -1;
+        }
+      }
+
+      std::vector<std::tuple<dyn::apiproc *, const char *>> funcs {
+        { (dyn::apiproc *) &error_init, "dbus_error_init" },
+        { (dyn::apiproc *) &error_free, "dbus_error_free" },
+        { (dyn::apiproc *) &bus_get, "dbus_bus_get" },
+        { (dyn::apiproc *) &connection_unref, "dbus_connection_unref" },
+        { (dyn::apiproc *) &message_new_method_call, "dbus_message_new_method_call" },
+        { (dyn::apiproc *) &message_append_args, "dbus_message_append_args" },
+        { (dyn::apiproc *) &connection_send_with_reply_and_block, "dbus_connection_send_with_reply_and_block" },
+        { (dyn::apiproc *) &message_unref, "dbus_message_unref" },
+      };
+
+      if (dyn::load(handle, funcs)) {
+        return -1;
+      }
+
+      funcs_loaded = true;
+      return 0;
+    }
+
+    using connection_t = util::dyn_safe_ptr<DBusConnection, &connection_unref>;
+    using message_t = util::dyn_safe_ptr<DBusMessage, &message_unref>;
+
+    // Guards loading libdbus-1
+    static std::mutex mutex;
+
+    /**
+     * Ask rtkit to raise the priority of a thread, for when we aren't allowed to do it ourselves
+     * method <-- MakeThreadHighPriority with a nice level or MakeThreadRealtime with a real-time priority
+     */
+    template <class T>
+    static int
+    call(const char *method, std::uint64_t tid, T priority) {
+      std::lock_guard lg { mutex };
+      if (init()) {
+        return -1;
+      }
+
+      DBusError error;
+      error_init(&error);
+      auto fg = util::fail_guard([&]() {
+        error_free(&error);
+      });
+
+      connection_t connection { bus_get(DBUS_BUS_SYSTEM, &error) };
+      if (!connection) {
+        BOOST_LOG(debug) << "Couldn't connect to the system bus: "sv << (error.message ? error.message : "unknown error");
+        return -1;
+      }
+
+      message_t message { message_new_method_call("org.freedesktop.RealtimeKit1", "/org/freedesktop/RealtimeKit1", "org.freedesktop.RealtimeKit1", method) };
+      if (!message) {
+        return -1;
+      }
+
+      constexpr int priority_type = std::is_signed_v<T> ? DBUS_TYPE_INT32 : DBUS_TYPE_UINT32;
+      if (!message_append_args(message.get(), DBUS_TYPE_UINT64, &tid, priority_type, &priority, DBUS_TYPE_INVALID)) {
+        return -1;
+      }
+
+      message_t reply { connection_send_with_reply_and_block(connection.get(), message.get(), 1000, &error) };
+      if (!reply) {
+        BOOST_LOG(debug) << "rtkit: "sv << method << " failed: "sv << (error.message ? error.message : "unknown error");
+        return -1;
+      }
+
+      return 0;
+    }
+  }  // namespace rtkit
+
+  /**
+   * Switch the calling thread to a real-time scheduling policy, directly or through rtkit.
+   * rtkit only grants real-time scheduling to processes that limit the CPU time of their real-time threads.
+   */
+  static int
+  set_realtime(pid_t tid, int policy, int rt_priority) {
+    sched_param param {};
+    param.sched_priority = rt_priority;
+
+    // Children, e.g. the apps that are launched, mustn't inherit the policy
+    if (!sched_setscheduler(tid, policy | SCHED_RESET_ON_FORK, &param)) {
+      return 0;
+    }
+
+    if (errno != EPERM) {
+      BOOST_LOG(warning) << "Unable to set the real-time scheduling policy: "sv << strerror(errno);
+      return -1;
+    }
+
+    if (rttime::lower()) {
+      return -1;
+    }
+
+    // rtkit only uses SCHED_RR
+    return rtkit::call("MakeThreadRealtime", tid, (std::uint32_t) rt_priority);
+  }
+
   void
   adjust_thread_priority(thread_priority_e priority) {
-    // Unimplemented
+    int nice;
+    int rt_priority;
+
+    switch (priority) {
+      case thread_priority_e::low:
+        nice = 10;
+        rt_priority = 0;
+        break;
+      case thread_priority_e::normal:
+        nice = 0;
+        rt_priority = 0;
+        break;
+      case thread_priority_e::high:
+        nice = -5;
+        rt_priority = 5;
+        break;
+      case thread_priority_e::critical:
+        nice = -10;
+        rt_priority = 10;
+        break;
+      default:
+        BOOST_LOG(error) << "Unknown thread priority: "sv << (int) priority;
+        return;
+    }
+
+    auto tid = (pid_t) syscall(SYS_gettid);
+
+    if (rt_priority && config::sunshine.thread_scheduler != "other"sv) {
+      auto policy = config::sunshine.thread_scheduler == "rr"sv ? SCHED_RR : SCHED_FIFO;
+      if (!set_realtime(tid, policy, rt_priority)) {
+        return;
+      }
+
+      BOOST_LOG(warning) << "Real-time scheduling isn't allowed, falling back to nice "sv << nice;
+    }
+
+    // On Linux, the nice value belongs to the thread
+    if (!setpriority(PRIO_PROCESS, tid, nice)) {
+      return;
+    }
+
+    auto err = errno;
+    if ((err == EACCES || err == EPERM) && !rtkit::call("MakeThreadHighPriority", tid, (std::int32_t) nice)) {
+      return;
+    }
+
+    BOOST_LOG(warning) << "Unable to set thread priority to nice "sv << nice << ": "sv << strerror(err);
+  }
+
+  void
+  adjust_thread_affinity(thread_role_e role) {
+    auto &cpus = config::cpu_affinity(role);
+    if (cpus.empty()) {
+      return;
+    }
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (auto cpu : cpus) {
+      if (cpu < CPU_SETSIZE) {
+        CPU_SET(cpu, &set);
+      }
+    }
+
+    if (auto err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set)) {
+      BOOST_LOG(warning) << "Unable to set thread affinity: "sv << strerror(err);
+    }
   }
 
   void
@@ -206,39 +533,235 @@ namespace platf {
     return false;
   }
 
-  bool
-  send_batch(batched_send_info_t &send_info) {
-    auto sockfd = (int) send_info.native_socket;
+  /**
+   * With MSG_ZEROCOPY, the kernel pins the pages of the buffer instead of copying them.
+   * The kernel numbers every sendmsg() with MSG_ZEROCOPY on a socket and reports ranges of
+   * completed sends on the error queue of the socket. Until then, the buffer must not change.
+   */
+  class zerocopy_t {
+  public:
+    ~zerocopy_t() {
+      if (sent_bytes || fallbacks) {
+        BOOST_LOG(info) << "MSG_ZEROCOPY: sent "sv << sent_bytes / 1024 << " KiB without copying, the kernel copied "sv
+                        << copied_bytes / 1024 << " KiB of it anyway, fell back to copying "sv << fallbacks << " times"sv;
+      }
+    }
+
+    /**
+     * return the flags for sendmsg() to send a buffer on sockfd without copying it
+     */
+    int
+    flags(int sockfd) {
+#ifdef SO_ZEROCOPY
+      if (sockfd != fd) {
+        // The previous socket has been closed
+        pending.clear();
+        first_id = 0;
+        fd = sockfd;
+
+        int enable = 1;
+        enabled = setsockopt(sockfd, SOL_SOCKET, SO_ZEROCOPY, &enable, sizeof(enable)) == 0;
+        if (!enabled) {
+          BOOST_LOG(warning) << "MSG_ZEROCOPY isn't available: "sv << strerror(errno);
+        }
+      }
 
-    // Convert the target address into a sockaddr
-    struct sockaddr_in saddr_v4 = {};
-    struct sockaddr_in6 saddr_v6 = {};
-    struct sockaddr *addr;
-    socklen_t addr_len;
-    if (send_info.target_address.is_v6()) {
-      auto address_v6 = send_info.target_address.to_v6();
+      if (enabled) {
+        return MSG_ZEROCOPY;
+      }
+#endif
 
-      saddr_v6.sin6_family = AF_INET6;
-      saddr_v6.sin6_port = htons(send_info.target_port);
-      saddr_v6.sin6_scope_id = address_v6.scope_id();
+      ++fallbacks;
+      return 0;
+    }
+
+    /**
+     * Hold on to owner until the kernel reports the last sendmsg() done
+     */
+    void
+    sent(const std::shared_ptr<void> &owner, std::size_t bytes) {
+      pending.emplace_back(send_t { bytes, false, owner });
+      sent_bytes += bytes;
+    }
+
+    /**
+     * The kernel ran out of memory to pin the pages
+     */
+    void
+    fallback() {
+      ++fallbacks;
+    }
+
+    /**
+     * Release the buffers of the completed sends
+     * Completions left on the error queue would also wake up poll() right away
+     */
+    void
+    drain(int sockfd) {
+#ifdef SO_ZEROCOPY
+      while (!pending.empty() && sockfd == fd) {
+        union {
+          char buf[CMSG_SPACE(sizeof(sock_extended_err))];
+          struct cmsghdr alignment;
+        } cmbuf;
+
+        struct msghdr msg = {};
+        msg.msg_control = cmbuf.buf;
+        msg.msg_controllen = sizeof(cmbuf.buf);
+
+        if (recvmsg(sockfd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) {
+          if (errno != EAGAIN) {
+            BOOST_LOG(warning) << "Couldn't read the error queue: "sv << strerror(errno);
+          }
+
+          return;
+        }
+
+        auto cm = CMSG_FIRSTHDR(&msg);
+        if (!cm ||
+            !((cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR) ||
+              (cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR))) {
+          continue;
+        }
+
+        auto err = (sock_extended_err *) CMSG_DATA(cm);
+        if (err->ee_origin != SO_EE_ORIGIN_ZEROCOPY) {
+          continue;
+        }
+
+        // The range [ee_info, ee_data] is inclusive
+        for (std::uint32_t x = 0; x <= err->ee_data - err->ee_info; ++x) {
+          std::size_t index = err->ee_info + x - first_id;
+          if (index >= pending.size()) {
+            continue;
+          }
+
+          auto &send = pending[index];
+          if (err->ee_code & SO_EE_CODE_ZEROCOPY_COPIED) {
+            copied_bytes += send.bytes;
+          }
+
+          send.done = true;
+          send.owner.reset();
+        }
+
+        // Completions may arrive out of order
+        while (!pending.empty() && pending.front().done) {
+          pending.pop_front();
+          ++first_id;
+        }
+      }
+#endif
+    }
+
+  private:
+    struct send_t {
+      std::size_t bytes;
+      bool done;
+      std::shared_ptr<void> owner;
+    };
+
+    int fd = -1;
+    bool enabled = false;
+
+    // The id of pending.front()
+    std::uint32_t first_id = 0;
+    std::deque<send_t> pending;
+
+    // Statistics
+    std::uint64_t sent_bytes = 0;
+    std::uint64_t copied_bytes = 0;
+    std::uint64_t fallbacks = 0;
+  };
+
+  /**
+   * Convert the target address into a sockaddr
+   * return the length of the sockaddr stored in saddr
+   */
+  static socklen_t
+  to_sockaddr(boost::asio::ip::address &address, uint16_t port, sockaddr_storage &saddr) {
+    saddr = {};
+
+    if (address.is_v6()) {
+      auto address_v6 = address.to_v6();
+      auto saddr_v6 = (struct sockaddr_in6 *) &saddr;
+
+      saddr_v6->sin6_family = AF_INET6;
+      saddr_v6->sin6_port = htons(port);
+      saddr_v6->sin6_scope_id = address_v6.scope_id();
 
       auto addr_bytes = address_v6.to_bytes();
-      memcpy(&saddr_v6.sin6_addr, addr_bytes.data(), sizeof(saddr_v6.sin6_addr));
+      memcpy(&saddr_v6->sin6_addr, addr_bytes.data(), sizeof(saddr_v6->sin6_addr));
 
-      addr = (struct sockaddr *) &saddr_v6;
-      addr_len = sizeof(saddr_v6);
+      return sizeof(*saddr_v6);
     }
-    else {
-      auto address_v4 = send_info.target_address.to_v4();
 
-      saddr_v4.sin_family = AF_INET;
-      saddr_v4.sin_port = htons(send_info.target_port);
+    auto address_v4 = address.to_v4();
+    auto saddr_v4 = (struct sockaddr_in *) &saddr;
+
+    saddr_v4->sin_family = AF_INET;
+    saddr_v4->sin_port = htons(port);
+
+    auto addr_bytes = address_v4.to_bytes();
+    memcpy(&saddr_v4->sin_addr, addr_bytes.data(), sizeof(saddr_v4->sin_addr));
+
+    return sizeof(*saddr_v4);
+  }
+
+  /**
+   * Call sendmmsg() until all messages are sent
+   */
+  static bool
+  send_all(int sockfd, struct mmsghdr *msgs, size_t count) {
+    size_t sent = 0;
+    while (sent < count) {
+      int msgs_sent = sendmmsg(sockfd, &msgs[sent], count - sent, 0);
+      if (msgs_sent < 0) {
+        // If there's no send buffer space, wait for some to be available
+        if (errno == EAGAIN) {
+          struct pollfd pfd;
+
+          pfd.fd = sockfd;
+          pfd.events = POLLOUT;
+
+          if (poll(&pfd, 1, -1) != 1) {
+            BOOST_LOG(warning) << "poll() failed: "sv << errno;
+            break;
+          }
+
+          // Try to send again
+          continue;
+        }
+
+        BOOST_LOG(warning) << "sendmmsg() failed: "sv << errno;
+        return false;
+      }
+
+      sent += msgs_sent;
+    }
+
+    return true;
+  }
+
+  bool
+  send_batch(batched_send_info_t &send_info) {
+    auto sockfd = (int) send_info.native_socket;
 
-      auto addr_bytes = address_v4.to_bytes();
-      memcpy(&saddr_v4.sin_addr, addr_bytes.data(), sizeof(saddr_v4.sin_addr));
+    struct sockaddr_storage saddr;
+    auto addr = (struct sockaddr *) &saddr;
+    auto addr_len = to_sockaddr(send_info.target_address, send_info.target_port, saddr);
 
-      addr = (struct sockaddr *) &saddr_v4;
-      addr_len = sizeof(saddr_v4);
+    if (config::stream.io_uring) {
+      auto sent = uring::send_batch(send_info, addr, addr_len);
+      if (sent == (int) send_info.block_count) {
+        return true;
+      }
+
+      // Send the rest of the datagrams below
+      if (sent > 0) {
+        send_info.buffer += sent * send_info.block_size;
+        send_info.block_count -= sent;
+      }
     }
 
 #ifdef UDP_SEGMENT
@@ -250,6 +773,12 @@ namespace platf {
         struct cmsghdr alignment;
       } cmbuf;
 
+      // The buffers of a thread's sends stay pinned until their completions are read
+      thread_local zerocopy_t zerocopy;
+      zerocopy.drain(sockfd);
+
+      int flags = send_info.owner ? zerocopy.flags(sockfd) : 0;
+
       // UDP GSO on Linux currently only supports sending 64K or 64 segments at a time
       size_t seg_index = 0;
       const size_t seg_max = 65536 / 1500;
@@ -282,10 +811,12 @@ namespace platf {
         // This will fail if GSO is not available, so we will fall back to non-GSO if
         // it's the first sendmsg() call. On subsequent calls, we will treat errors as
         // actual failures and return to the caller.
-        auto bytes_sent = sendmsg(sockfd, &msg, 0);
+        auto bytes_sent = sendmsg(sockfd, &msg, flags);
         if (bytes_sent < 0) {
           // If there's no send buffer space, wait for some to be available
           if (errno == EAGAIN) {
+            zerocopy.drain(sockfd);
+
             struct pollfd pfd;
 
             pfd.fd = sockfd;
@@ -300,9 +831,20 @@ namespace platf {
             continue;
           }
 
+          // Copy the rest of the buffer
+          if (errno == ENOBUFS && (flags & MSG_ZEROCOPY)) {
+            zerocopy.fallback();
+            flags = 0;
+            continue;
+          }
+
           break;
         }
 
+        if (flags & MSG_ZEROCOPY) {
+          zerocopy.sent(send_info.owner, bytes_sent);
+        }
+
         seg_index += bytes_sent / send_info.block_size;
       }
 
@@ -329,36 +871,79 @@ namespace platf {
         msgs[i].msg_hdr.msg_iovlen = 1;
       }
 
-      // Call sendmmsg() until all messages are sent
-      size_t blocks_sent = 0;
-      while (blocks_sent < send_info.block_count) {
-        int msgs_sent = sendmmsg(sockfd, &msgs[blocks_sent], send_info.block_count - blocks_sent, 0);
-        if (msgs_sent < 0) {
-          // If there's no send buffer space, wait for some to be available
-          if (errno == EAGAIN) {
-            struct pollfd pfd;
+      return send_all(sockfd, msgs, send_info.block_count);
+    }
+  }
 
-            pfd.fd = sockfd;
-            pfd.events = POLLOUT;
+  bool
+  send_batch(multi_send_info_t &send_info) {
+    struct sockaddr_storage saddr;
+    auto addr_len = to_sockaddr(send_info.target_address, send_info.target_port, saddr);
+
+    struct mmsghdr msgs[send_info.datagram_count];
+    struct iovec iovs[send_info.datagram_count];
+    for (size_t i = 0; i < send_info.datagram_count; i++) {
+      iovs[i] = {};
+      iovs[i].iov_base = (void *) send_info.datagrams[i].data();
+      iovs[i].iov_len = send_info.datagrams[i].size();
+
+      msgs[i] = {};
+      msgs[i].msg_hdr.msg_name = &saddr;
+      msgs[i].msg_hdr.msg_namelen = addr_len;
+      msgs[i].msg_hdr.msg_iov = &iovs[i];
+      msgs[i].msg_hdr.msg_iovlen = 1;
+    }
 
-            if (poll(&pfd, 1, -1) != 1) {
-              BOOST_LOG(warning) << "poll() failed: "sv << errno;
-              break;
-            }
+    return send_all((int) send_info.native_socket, msgs, send_info.datagram_count);
+  }
 
-            // Try to send again
-            continue;
-          }
+  /**
+   * Estimate the memory the kernel charges a socket for a queued datagram, its truesize:
+   * the payload and headers rounded up to the kmalloc bucket holding them and the skb_shared_info,
+   * plus the sk_buff itself.
+   */
+  static std::int64_t
+  datagram_truesize(std::size_t datagram_size) {
+    // Headroom for the link layer, IPv6 and UDP headers
+    constexpr std::size_t header_room = 128;
+    constexpr std::size_t shared_info_size = 320;
+    constexpr std::size_t sk_buff_size = 256;
+
+    std::size_t data_size = 64;
+    while (data_size < datagram_size + header_room + shared_info_size) {
+      data_size *= 2;
+    }
 
-          BOOST_LOG(warning) << "sendmmsg() failed: "sv << errno;
-          return false;
-        }
+    return (std::int64_t) (data_size + sk_buff_size);
+  }
 
-        blocks_sent += msgs_sent;
-      }
+  std::int64_t
+  send_queue_bytes(std::uintptr_t native_socket, std::size_t datagram_size) {
+    auto sockfd = (int) native_socket;
+
+    std::int64_t charged = -1;
 
-      return true;
+#ifdef SO_MEMINFO
+    // The datagrams in the queueing discipline and the driver, not yet freed by the NIC
+    std::uint32_t meminfo[SK_MEMINFO_VARS];
+    socklen_t len = sizeof(meminfo);
+    if (getsockopt(sockfd, SOL_SOCKET, SO_MEMINFO, meminfo, &len) == 0 && len > SK_MEMINFO_WMEM_ALLOC * sizeof(std::uint32_t)) {
+      charged = meminfo[SK_MEMINFO_WMEM_ALLOC];
     }
+#endif
+
+    // SO_MEMINFO was added in Linux 4.12, SIOCOUTQ reports the same for UDP sockets
+    int queued;
+    if (charged < 0 && ioctl(sockfd, SIOCOUTQ, &queued) == 0) {
+      charged = queued;
+    }
+
+    if (charged < 0 || !datagram_size) {
+      return charged;
+    }
+
+    // Both report the truesize of the queued skbs, not their payload
+    return charged * (std::int64_t) datagram_size / datagram_truesize(datagram_size);
   }
 
   class qos_t: public deinit_t {
@@ -432,6 +1017,7 @@ namespace platf {
 #ifdef SUNSHINE_BUILD_X11
       X11,
 #endif
+      SYNTHETIC,
       MAX_FLAGS
     };
   }  // namespace source
@@ -486,8 +1072,14 @@ namespace platf {
   }
 #endif
 
+  std::vector<std::string>
+  synth_display_names();
+  std::shared_ptr<display_t>
+  synth_display(mem_type_e hwdevice_type, const std::string &display_name, const video::config_t &config);
+
   std::vector<std::string>
   display_names(mem_type_e hwdevice_type) {
+    if (sources[source::SYNTHETIC]) return synth_display_names();
 #ifdef SUNSHINE_BUILD_CUDA
     // display using NvFBC only supports mem_type_e::cuda
     if (sources[source::NVFBC] && hwdevice_type == mem_type_e::cuda) return nvfbc_display_names();
@@ -506,6 +1098,10 @@ namespace platf {
 
   std::shared_ptr<display_t>
   display(mem_type_e hwdevice_type, const std::string &display_name, const video::config_t &config) {
+    if (sources[source::SYNTHETIC]) {
+      BOOST_LOG(info) << "Screencasting with the synthetic source"sv;
+      return synth_display(hwdevice_type, display_name, config);
+    }
 #ifdef SUNSHINE_BUILD_CUDA
     if (sources[source::NVFBC] && hwdevice_type == mem_type_e::cuda) {
       BOOST_LOG(info) << "Screencasting with NvFBC"sv;
@@ -556,6 +1152,11 @@ namespace platf {
     }
 #endif
 
+    // Never picked automatically, it doesn't show anything real
+    if (config::video.capture == "synthetic") {
+      sources[source::SYNTHETIC] = true;
+    }
+
 #ifdef SUNSHINE_BUILD_CUDA
     if (config::video.capture.empty() || config::video.capture == "nvfbc") {
       if (verify_nvfbc()) {
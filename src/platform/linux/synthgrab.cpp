@@ -0,0 +1,405 @@
+/**
+ * @file synthgrab.cpp
+ *
+ * Capture without a display: either a moving test pattern, or raw BGR0 frames replayed from a file.
+ * This allows profiling the whole capture->convert->encode->packetize pipeline on a headless machine.
+ */
+#include "src/platform/common.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "src/capture_trace.h"
+#include "src/config.h"
+#include "src/main.h"
+#include "src/video.h"
+
+#include "cuda.h"
+#include "misc.h"
+#include "vaapi.h"
+
+using namespace std::literals;
+
+namespace platf {
+  struct synth_img_t: public img_t {
+    ~synth_img_t() override {
+      delete[] buffer;
+    }
+
+    // nullptr while data points into the replayed file
+    std::uint8_t *buffer {};
+  };
+
+  class mmap_t {
+  public:
+    mmap_t() = default;
+    mmap_t(mmap_t &&) = delete;
+
+    ~mmap_t() {
+      if (data != MAP_FAILED) {
+        munmap(data, size);
+      }
+    }
+
+    void *data { MAP_FAILED };
+    std::size_t size {};
+  };
+
+  class synth_display_t: public display_t {
+  public:
+    int
+    init(mem_type_e hwdevice_type, const ::video::config_t &config) {
+      delay = std::chrono::nanoseconds { 1s } / config.framerate;
+      mem_type = hwdevice_type;
+
+      width = config.width;
+      height = config.height;
+      row_pitch = width * 4;
+
+      if (config::video.capture_file.empty()) {
+        BOOST_LOG(info) << "Rendering a "sv << width << 'x' << height << " test pattern at "sv << config.framerate << " fps"sv;
+
+        make_pattern();
+      }
+      else if (map_file(config::video.capture_file)) {
+        return -1;
+      }
+
+      env_width = width;
+      env_height = height;
+
+      return 0;
+    }
+
+    /**
+     * The replayed file is either a capture trace, or a plain sequence of BGR0 frames at the requested resolution.
+     * It's mapped copy-on-write, so consumers that write to an image don't alter the file.
+     */
+    int
+    map_file(const std::string &path) {
+      file_t fd = open(path.c_str(), O_RDONLY);
+      if (fd.el < 0) {
+        BOOST_LOG(error) << "Couldn't open ["sv << path << "]: "sv << strerror(errno);
+        return -1;
+      }
+
+      struct stat st;
+      if (fstat(fd.el, &st)) {
+        BOOST_LOG(error) << "Couldn't stat ["sv << path << "]: "sv << strerror(errno);
+        return -1;
+      }
+
+      file.size = st.st_size;
+      file.data = mmap(nullptr, file.size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd.el, 0);
+      if (file.data == MAP_FAILED) {
+        BOOST_LOG(error) << "Couldn't mmap ["sv << path << "]: "sv << strerror(errno);
+        return -1;
+      }
+
+      madvise(file.data, file.size, MADV_SEQUENTIAL);
+
+      if (capture_trace::is_trace(file.data, file.size)) {
+        if (map_trace()) {
+          BOOST_LOG(error) << '[' << path << "] is not a valid capture trace"sv;
+          return -1;
+        }
+
+        frame_count = trace_frames.size();
+      }
+      else {
+        auto frame_size = (std::size_t) row_pitch * height;
+        if (file.size < frame_size || file.size % frame_size) {
+          BOOST_LOG(error) << '[' << path << "] doesn't contain whole "sv << width << 'x' << height << " BGR0 frames"sv;
+          return -1;
+        }
+
+        frame_count = file.size / frame_size;
+      }
+
+      BOOST_LOG(info) << "Replaying "sv << frame_count << " frames from ["sv << path << ']';
+
+      return 0;
+    }
+
+    /**
+     * The resolution is taken from the first frame of the trace.
+     * Frames recorded at another resolution, before or after a reinit, are skipped.
+     */
+    int
+    map_trace() {
+      auto begin = (const std::uint8_t *) file.data;
+      auto header = (const capture_trace::file_header_t *) begin;
+
+      if (header->version != capture_trace::version || !header->index_offset || !header->frame_count ||
+          header->index_offset > file.size || (file.size - header->index_offset) / sizeof(std::uint64_t) < header->frame_count) {
+        return -1;
+      }
+
+      auto index = (const std::uint64_t *) (begin + header->index_offset);
+      for (std::uint64_t x = 0; x < header->frame_count; ++x) {
+        if (file.size < sizeof(capture_trace::frame_header_t) || index[x] > file.size - sizeof(capture_trace::frame_header_t)) {
+          return -1;
+        }
+
+        auto frame = (const capture_trace::frame_header_t *) (begin + index[x]);
+        if (frame->payload_offset > file.size || file.size - frame->payload_offset < frame->payload_size) {
+          return -1;
+        }
+
+        if (trace_frames.empty()) {
+          // Frames are replayed as BGR0 no matter what, the first one decides the layout
+          if (frame->encoding != capture_trace::encoding_e::raw || frame->pixel_pitch != 4) {
+            return -1;
+          }
+
+          width = frame->width;
+          height = frame->height;
+          row_pitch = frame->row_pitch;
+        }
+
+        if (frame->width != width || frame->height != height || frame->row_pitch != row_pitch) {
+          continue;
+        }
+
+        // Raw frames are replayed straight from the mapping
+        if (frame->encoding == capture_trace::encoding_e::raw && frame->payload_size < (std::uint64_t) row_pitch * height) {
+          return -1;
+        }
+
+        trace_frames.emplace_back(frame);
+      }
+
+      return 0;
+    }
+
+    /**
+     * Colour bars over a grey ramp.
+     * Each frame scrolls it horizontally, so every row changes from one frame to the next.
+     */
+    void
+    make_pattern() {
+      static constexpr std::uint32_t bars[] {
+        0xFFC0C0C0, 0xFFC0C000, 0xFF00C0C0, 0xFF00C000, 0xFFC000C0, 0xFFC00000, 0xFF0000C0, 0xFF101010
+      };
+
+      pattern.resize((std::size_t) width * height);
+
+      auto bars_height = height * 2 / 3;
+      for (int y = 0; y < height; ++y) {
+        auto row = &pattern[(std::size_t) y * width];
+
+        for (int x = 0; x < width; ++x) {
+          if (y < bars_height) {
+            row[x] = bars[x * std::size(bars) / width];
+          }
+          else {
+            std::uint32_t grey = x * 255 / std::max(width - 1, 1);
+            row[x] = 0xFF000000 | grey << 16 | grey << 8 | grey;
+          }
+        }
+      }
+    }
+
+    void
+    render_pattern(img_t *img) {
+      auto scroll = (int) (frame_nr * 4 % width);
+
+      for (int y = 0; y < height; ++y) {
+        auto src = &pattern[(std::size_t) y * width];
+        auto dst = (std::uint32_t *) (img->data + y * img->row_pitch);
+
+        std::copy(src + scroll, src + width, dst);
+        std::copy(src, src + scroll, dst + width - scroll);
+      }
+
+      // A white box bouncing across the frame
+      auto box = std::max(height / 8, 1);
+      auto span_x = std::max(width - box, 1);
+      auto span_y = std::max(height - box, 1);
+
+      auto box_x = (int) (frame_nr * 7 % (span_x * 2));
+      auto box_y = (int) (frame_nr * 5 % (span_y * 2));
+      box_x = std::min(box_x < span_x ? box_x : span_x * 2 - box_x, width - box);
+      box_y = std::min(box_y < span_y ? box_y : span_y * 2 - box_y, height - box);
+
+      for (int y = box_y; y < box_y + box; ++y) {
+        auto dst = (std::uint32_t *) (img->data + y * img->row_pitch) + box_x;
+        std::fill_n(dst, box, 0xFFFFFFFF);
+      }
+    }
+
+    capture_e
+    capture(snapshot_cb_t &&snapshot_cb, std::shared_ptr<img_t> img, bool *cursor) override {
+      auto next_frame = std::chrono::steady_clock::now();
+
+      while (img) {
+        auto now = std::chrono::steady_clock::now();
+
+        if (next_frame > now) {
+          std::this_thread::sleep_for((next_frame - now) / 3 * 2);
+        }
+        while (next_frame > now) {
+          std::this_thread::sleep_for(1ns);
+          now = std::chrono::steady_clock::now();
+        }
+        next_frame = now + delay;
+
+        auto status = snapshot(img.get());
+        switch (status) {
+          case platf::capture_e::reinit:
+          case platf::capture_e::error:
+            return status;
+          case platf::capture_e::ok:
+            img = snapshot_cb(img, true);
+            break;
+          default:
+            BOOST_LOG(error) << "Unrecognized capture status ["sv << (int) status << ']';
+            return status;
+        }
+      }
+
+      return capture_e::ok;
+    }
+
+    capture_e
+    snapshot(img_t *img_out_base) {
+      auto img = (synth_img_t *) img_out_base;
+
+      // Whatever isn't covered below is unknown, like a raw frame of a trace that may differ anywhere
+      img->damage.clear();
+      img->damage_complete = false;
+
+      auto frame_size = (std::size_t) row_pitch * height;
+      if (!trace_frames.empty()) {
+        auto frame = trace_frames[frame_nr % frame_count];
+        auto payload = (std::uint8_t *) file.data + frame->payload_offset;
+
+        if (frame->encoding == capture_trace::encoding_e::raw) {
+          img->data = payload;
+        }
+        else {
+          if (!img->buffer) {
+            img->buffer = new std::uint8_t[frame_size];
+          }
+
+          if (capture_trace::apply_delta(payload, frame->payload_size, prev_frame.data(), img->buffer, frame_size) ||
+              capture_trace::delta_damage(payload, frame->payload_size, width, height, row_pitch, img->damage)) {
+            BOOST_LOG(error) << "Corrupt frame in capture trace"sv;
+            return capture_e::error;
+          }
+
+          img->data = img->buffer;
+          img->damage_complete = true;
+        }
+
+        // The image may be released or reused before the next delta is applied, so keep a copy of our own
+        auto next = trace_frames[(frame_nr + 1) % frame_count];
+        if (next->encoding != capture_trace::encoding_e::raw) {
+          prev_frame.resize(frame_size);
+          std::copy_n(img->data, frame_size, std::begin(prev_frame));
+        }
+      }
+      else if (file.data != MAP_FAILED) {
+        // No copy, the image simply points at the next frame
+        img->data = (std::uint8_t *) file.data + (frame_nr % frame_count) * frame_size;
+      }
+      else {
+        img->data = img->buffer;
+        render_pattern(img);
+
+        // The scrolling pattern changes every row
+        img->damage.emplace_back(rect_t { 0, 0, width, height });
+        img->damage_complete = true;
+      }
+
+      ++frame_nr;
+
+      return capture_e::ok;
+    }
+
+    std::shared_ptr<img_t>
+    alloc_img() override {
+      auto img = std::make_shared<synth_img_t>();
+      img->width = width;
+      img->height = height;
+      img->pixel_pitch = 4;
+      img->row_pitch = row_pitch;
+
+      if (file.data == MAP_FAILED) {
+        img->buffer = new std::uint8_t[height * img->row_pitch];
+        img->data = img->buffer;
+      }
+      else {
+        img->data = (std::uint8_t *) file.data;
+      }
+
+      return img;
+    }
+
+    int
+    dummy_img(img_t *img) override {
+      auto synth_img = (synth_img_t *) img;
+
+      // Replayed frames are read-only as far as the file is concerned, so give the dummy image its own memory
+      if (!synth_img->buffer) {
+        synth_img->buffer = new std::uint8_t[height * img->row_pitch];
+        synth_img->data = synth_img->buffer;
+      }
+
+      std::fill_n(img->data, height * img->row_pitch, 0);
+      return 0;
+    }
+
+    std::shared_ptr<hwdevice_t>
+    make_hwdevice(pix_fmt_e pix_fmt) override {
+      if (mem_type == mem_type_e::vaapi) {
+        return va::make_hwdevice(width, height, false);
+      }
+
+#ifdef SUNSHINE_BUILD_CUDA
+      if (mem_type == mem_type_e::cuda) {
+        return cuda::make_hwdevice(width, height, false);
+      }
+#endif
+
+      return std::make_shared<hwdevice_t>();
+    }
+
+    std::chrono::nanoseconds delay;
+    mem_type_e mem_type;
+
+    std::uint64_t frame_nr {};
+    int row_pitch;
+
+    std::vector<std::uint32_t> pattern;
+
+    mmap_t file;
+    std::uint64_t frame_count {};
+
+    std::vector<const capture_trace::frame_header_t *> trace_frames;
+
+    // The last replayed frame of a trace, delta frames are applied on top of it
+    std::vector<std::uint8_t> prev_frame;
+  };
+
+  std::vector<std::string>
+  synth_display_names() {
+    return { "0"s };
+  }
+
+  std::shared_ptr<display_t>
+  synth_display(mem_type_e hwdevice_type, const std::string &display_name, const ::video::config_t &config) {
+    if (hwdevice_type != mem_type_e::system && hwdevice_type != mem_type_e::vaapi && hwdevice_type != mem_type_e::cuda) {
+      BOOST_LOG(error) << "Could not initialize synthetic display with the given hw device type"sv;
+      return nullptr;
+    }
+
+    auto disp = std::make_shared<synth_display_t>();
+    if (disp->init(hwdevice_type, config)) {
+      return nullptr;
+    }
+
+    return disp;
+  }
+}  // namespace platf
@@ -0,0 +1,486 @@
+/**
+ * @file uring.cpp
+ */
+
+// standard includes
+#include <cerrno>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+// lib includes
+#include <linux/io_uring.h>
+#include <netinet/udp.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// local includes
+#include "src/main.h"
+#include "uring.h"
+
+using namespace std::literals;
+
+namespace uring {
+  // A single sendmsg() with UDP_SEGMENT carries up to 64 segments or 64 KiB
+  constexpr std::size_t MAX_REQUEST_SIZE = 65536;
+  constexpr std::size_t MAX_SEGMENTS = 64;
+
+  // Enough for a few large key frames in flight
+  constexpr std::size_t SLOT_COUNT = 64;
+
+  // Every slot has an entry in the submission queue, so it can't overflow
+  constexpr unsigned RING_ENTRIES = 128;
+
+  static int
+  io_uring_setup(unsigned entries, io_uring_params *params) {
+    return (int) syscall(__NR_io_uring_setup, entries, params);
+  }
+
+  static int
+  io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return (int) syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0);
+  }
+
+  static int
+  io_uring_register(int fd, unsigned opcode, const void *arg, unsigned nr_args) {
+    return (int) syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+  }
+
+  class ring_t {
+  public:
+    ring_t() = default;
+    ring_t(const ring_t &) = delete;
+
+    ~ring_t() {
+      if (fd >= 0) {
+        // The kernel may still read the slots and the buffers they hold on to
+        while (in_flight() && reap(true) >= 0) {}
+
+        BOOST_LOG(info) << "io_uring: sent "sv << datagrams << " datagrams with "sv << requests << " requests in "sv
+                        << syscalls << " syscalls, "sv << failures << " requests failed, "sv << cancelled << " cancelled"sv;
+
+        close(fd);
+      }
+
+      if (sqes != MAP_FAILED) {
+        munmap(sqes, sqes_size);
+      }
+      if (cq_ring != MAP_FAILED && cq_ring != sq_ring) {
+        munmap(cq_ring, cq_ring_size);
+      }
+      if (sq_ring != MAP_FAILED) {
+        munmap(sq_ring, sq_ring_size);
+      }
+    }
+
+    static std::unique_ptr<ring_t>
+    make() {
+      auto ring = std::make_unique<ring_t>();
+
+      io_uring_params params {};
+      ring->fd = io_uring_setup(RING_ENTRIES, &params);
+      if (ring->fd < 0) {
+        BOOST_LOG(warning) << "io_uring isn't available: "sv << strerror(errno);
+        return nullptr;
+      }
+
+      ring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+      ring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+
+      bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+      if (single_mmap) {
+        ring->sq_ring_size = ring->cq_ring_size = std::max(ring->sq_ring_size, ring->cq_ring_size);
+      }
+
+      ring->sq_ring = mmap(nullptr, ring->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+      if (ring->sq_ring == MAP_FAILED) {
+        BOOST_LOG(warning) << "Couldn't map the submission queue of io_uring: "sv << strerror(errno);
+        return nullptr;
+      }
+
+      ring->cq_ring = single_mmap ?
+                        ring->sq_ring :
+                        mmap(nullptr, ring->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+      if (ring->cq_ring == MAP_FAILED) {
+        BOOST_LOG(warning) << "Couldn't map the completion queue of io_uring: "sv << strerror(errno);
+        return nullptr;
+      }
+
+      ring->sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+      ring->sqes = (io_uring_sqe *) mmap(nullptr, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+      if (ring->sqes == MAP_FAILED) {
+        BOOST_LOG(warning) << "Couldn't map the submission entries of io_uring: "sv << strerror(errno);
+        return nullptr;
+      }
+
+      auto sq = (char *) ring->sq_ring;
+      ring->sq_head = (unsigned *) (sq + params.sq_off.head);
+      ring->sq_tail = (unsigned *) (sq + params.sq_off.tail);
+      ring->sq_mask = *(unsigned *) (sq + params.sq_off.ring_mask);
+      ring->sq_array = (unsigned *) (sq + params.sq_off.array);
+
+      auto cq = (char *) ring->cq_ring;
+      ring->cq_head = (unsigned *) (cq + params.cq_off.head);
+      ring->cq_tail = (unsigned *) (cq + params.cq_off.tail);
+      ring->cq_mask = *(unsigned *) (cq + params.cq_off.ring_mask);
+      ring->cqes = (io_uring_cqe *) (cq + params.cq_off.cqes);
+
+      ring->sq_local_tail = *ring->sq_tail;
+
+      if (!ring->supports(IORING_OP_SENDMSG)) {
+        BOOST_LOG(warning) << "io_uring doesn't support sendmsg() on this kernel"sv;
+        return nullptr;
+      }
+
+      ring->slots.resize(SLOT_COUNT);
+      for (std::size_t x = 0; x < SLOT_COUNT; ++x) {
+        ring->free_slots.emplace_back(SLOT_COUNT - x - 1);
+      }
+
+      BOOST_LOG(info) << "Sending video through io_uring"sv;
+
+      return ring;
+    }
+
+    /**
+     * return the number of datagrams handed to the kernel, -1 if none
+     */
+    int
+    send_batch(const platf::batched_send_info_t &send_info, const sockaddr *addr, socklen_t addr_len) {
+      // The kernel reads the datagrams after this returns
+      if (!send_info.owner) {
+        return -1;
+      }
+
+      auto sockfd = (int) send_info.native_socket;
+      if (sockfd != registered_socket && register_socket(sockfd)) {
+        return -1;
+      }
+
+      // Free the slots of the previous batches that are done
+      if (reap(false) < 0) {
+        return -1;
+      }
+
+      auto per_slot = gso ? std::min(MAX_REQUEST_SIZE / send_info.block_size, MAX_SEGMENTS) : 1;
+      if (!per_slot) {
+        return -1;
+      }
+
+      for (std::size_t seg_index = 0; seg_index < send_info.block_count;) {
+        if (free_slots.empty()) {
+          // Wait until the kernel is done with some of the slots
+          if (submit() < 0 || reap(true) < 0) {
+            return abandon(seg_index);
+          }
+
+          continue;
+        }
+
+        auto slot_index = free_slots.back();
+        free_slots.pop_back();
+
+        auto &slot = slots[slot_index];
+        auto segments = std::min(per_slot, send_info.block_count - seg_index);
+        slot.segments = segments;
+        slot.owner = send_info.owner;
+
+        std::memcpy(&slot.addr, addr, addr_len);
+
+        slot.iov.iov_base = (void *) &send_info.buffer[seg_index * send_info.block_size];
+        slot.iov.iov_len = segments * send_info.block_size;
+
+        slot.msg = {};
+        slot.msg.msg_name = &slot.addr;
+        slot.msg.msg_namelen = addr_len;
+        slot.msg.msg_iov = &slot.iov;
+        slot.msg.msg_iovlen = 1;
+
+#ifdef UDP_SEGMENT
+        if (segments > 1) {
+          slot.msg.msg_control = slot.control.buf;
+          slot.msg.msg_controllen = sizeof(slot.control.buf);
+
+          auto cm = CMSG_FIRSTHDR(&slot.msg);
+          cm->cmsg_level = SOL_UDP;
+          cm->cmsg_type = UDP_SEGMENT;
+          cm->cmsg_len = CMSG_LEN(sizeof(std::uint16_t));
+          *((std::uint16_t *) CMSG_DATA(cm)) = send_info.block_size;
+        }
+#endif
+
+        auto sqe = &sqes[sq_local_tail & sq_mask];
+        std::memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode = IORING_OP_SENDMSG;
+        sqe->fd = 0;  // Index of the registered socket
+        sqe->addr = (std::uint64_t) &slot.msg;
+        sqe->len = 1;
+        sqe->user_data = slot_index;
+
+        // Linked requests start one after the other, so the datagrams of a submission leave in order.
+        // Submissions aren't ordered against each other, but sendmsg() is issued as it's submitted:
+        // a later frame can only overtake an earlier one when the socket buffer is already full.
+        sqe->flags = IOSQE_FIXED_FILE | IOSQE_IO_LINK;
+
+        sq_array[sq_local_tail & sq_mask] = sq_local_tail & sq_mask;
+        last_sqe = sqe;
+        ++sq_local_tail;
+
+        seg_index += segments;
+        datagrams += segments;
+        ++requests;
+      }
+
+      if (submit() < 0) {
+        return abandon(send_info.block_count);
+      }
+
+      return (int) send_info.block_count;
+    }
+
+  private:
+    struct slot_t {
+      msghdr msg;
+      iovec iov;
+      sockaddr_storage addr;
+      std::size_t segments;
+
+      // Keeps the datagrams alive until the request completes
+      std::shared_ptr<void> owner;
+
+      // cmsghdr ends in a flexible array member, it has to be the last member
+      union {
+        char buf[CMSG_SPACE(sizeof(std::uint16_t))];
+        cmsghdr alignment;
+      } control;
+    };
+
+    bool
+    supports(int opcode) {
+      std::vector<std::uint8_t> buffer(sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op));
+      auto probe = (io_uring_probe *) buffer.data();
+
+      // Probing was added in Linux 5.6, sendmsg() in 5.3
+      if (io_uring_register(fd, IORING_REGISTER_PROBE, probe, 256) < 0) {
+        return false;
+      }
+
+      return opcode <= probe->last_op && (probe->ops[opcode].flags & IO_URING_OP_SUPPORTED);
+    }
+
+    int
+    register_socket(int sockfd) {
+      if (registered_socket >= 0) {
+        // Requests referring to the old socket have to complete first
+        while (in_flight()) {
+          if (reap(true) < 0) {
+            return -1;
+          }
+        }
+
+        io_uring_register(fd, IORING_UNREGISTER_FILES, nullptr, 0);
+        registered_socket = -1;
+      }
+
+      if (io_uring_register(fd, IORING_REGISTER_FILES, &sockfd, 1) < 0) {
+        BOOST_LOG(warning) << "Couldn't register the socket with io_uring: "sv << strerror(errno);
+        return -1;
+      }
+      registered_socket = sockfd;
+
+      gso = false;
+#ifdef UDP_SEGMENT
+      int segment_size;
+      socklen_t len = sizeof(segment_size);
+      gso = getsockopt(sockfd, SOL_UDP, UDP_SEGMENT, &segment_size, &len) == 0;
+#endif
+
+      return 0;
+    }
+
+    std::size_t
+    in_flight() const {
+      return slots.size() - free_slots.size();
+    }
+
+    /**
+     * Hand the queued requests to the kernel
+     */
+    int
+    submit() {
+      if (last_sqe) {
+        // The link ends with the submission
+        last_sqe->flags &= ~IOSQE_IO_LINK;
+        last_sqe = nullptr;
+      }
+
+      __atomic_store_n(sq_tail, sq_local_tail, __ATOMIC_RELEASE);
+
+      auto to_submit = sq_local_tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+      while (to_submit) {
+        auto ret = io_uring_enter(fd, to_submit, 0, 0);
+        ++syscalls;
+
+        if (ret < 0) {
+          if (errno == EINTR) {
+            continue;
+          }
+
+          // The completion queue is full
+          if ((errno == EAGAIN || errno == EBUSY) && reap(true) >= 0) {
+            continue;
+          }
+
+          BOOST_LOG(error) << "io_uring_enter() failed: "sv << strerror(errno);
+          return -1;
+        }
+
+        to_submit -= ret;
+      }
+
+      return 0;
+    }
+
+    /**
+     * Give up on the rest of a batch after a failure
+     * queued <-- The number of datagrams of the batch queued on the ring so far
+     * return the number of datagrams handed to the kernel, -1 if none
+     */
+    int
+    abandon(std::size_t queued) {
+      // Take back the requests the kernel hasn't consumed, the caller sends those datagrams itself
+      auto head = __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+      for (; sq_local_tail != head; --sq_local_tail) {
+        auto slot_index = sqes[(sq_local_tail - 1) & sq_mask].user_data;
+
+        queued -= slots[slot_index].segments;
+        datagrams -= slots[slot_index].segments;
+        --requests;
+
+        slots[slot_index].owner.reset();
+        free_slots.emplace_back(slot_index);
+      }
+      __atomic_store_n(sq_tail, sq_local_tail, __ATOMIC_RELEASE);
+      last_sqe = nullptr;
+
+      // The datagrams of the caller must leave after the ones already submitted
+      while (in_flight() && reap(true) >= 0) {}
+
+      return queued ? (int) queued : -1;
+    }
+
+    /**
+     * Return the slots of the completed requests
+     * wait <-- Block until at least one request completes
+     */
+    int
+    reap(bool wait) {
+      if (wait) {
+        auto ret = io_uring_enter(fd, 0, 1, IORING_ENTER_GETEVENTS);
+        ++syscalls;
+
+        if (ret < 0 && errno != EINTR) {
+          BOOST_LOG(error) << "io_uring_enter() failed: "sv << strerror(errno);
+          return -1;
+        }
+      }
+
+      auto head = *cq_head;
+      auto tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+
+      int completed = 0;
+      int error = 0;
+      std::size_t lost = 0;
+      for (; head != tail; ++head, ++completed) {
+        auto cqe = &cqes[head & cq_mask];
+
+        if (cqe->res < 0) {
+          lost += slots[cqe->user_data].segments;
+
+          // A failed request cancels the requests linked after it
+          if (cqe->res == -ECANCELED) {
+            ++cancelled;
+          }
+          else {
+            ++failures;
+            error = -cqe->res;
+          }
+        }
+
+        slots[cqe->user_data].owner.reset();
+        free_slots.emplace_back(cqe->user_data);
+      }
+
+      __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+
+      if (lost) {
+        // A persistent error would fail every frame, only a new one is worth a warning
+        auto &log = error != last_error ? warning : verbose;
+        BOOST_LOG(log) << "io_uring: "sv << lost << " datagrams weren't sent: "sv << (error ? strerror(error) : "request cancelled");
+
+        last_error = error;
+      }
+
+      return completed;
+    }
+
+    int fd = -1;
+
+    void *sq_ring = MAP_FAILED;
+    std::size_t sq_ring_size = 0;
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned sq_mask;
+    unsigned *sq_array;
+    unsigned sq_local_tail;
+
+    io_uring_sqe *sqes = (io_uring_sqe *) MAP_FAILED;
+    std::size_t sqes_size = 0;
+    io_uring_sqe *last_sqe = nullptr;
+
+    void *cq_ring = MAP_FAILED;
+    std::size_t cq_ring_size = 0;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned cq_mask;
+    io_uring_cqe *cqes;
+
+    std::vector<slot_t> slots;
+    std::vector<std::size_t> free_slots;
+
+    int registered_socket = -1;
+    bool gso = false;
+
+    // The error of the last failed request, to warn only once about a persistent error
+    int last_error = 0;
+
+    // Statistics
+    std::uint64_t datagrams = 0;
+    std::uint64_t requests = 0;
+    std::uint64_t syscalls = 0;
+    std::uint64_t failures = 0;
+    std::uint64_t cancelled = 0;
+  };
+
+  int
+  send_batch(const platf::batched_send_info_t &send_info, const sockaddr *addr, socklen_t addr_len) {
+    // Each thread sending datagrams has its own ring
+    thread_local std::unique_ptr<ring_t> ring;
+    thread_local bool unavailable = false;
+
+    if (!ring) {
+      if (unavailable) {
+        return -1;
+      }
+
+      ring = ring_t::make();
+      if (!ring) {
+        unavailable = true;
+        return -1;
+      }
+    }
+
+    return ring->send_batch(send_info, addr, addr_len);
+  }
+}  // namespace uring
@@ -0,0 +1,27 @@
+/**
+ * @file uring.h
+ */
+#ifndef SUNSHINE_PLATFORM_LINUX_URING_H
+#define SUNSHINE_PLATFORM_LINUX_URING_H
+
+#include <sys/socket.h>
+
+#include "src/platform/common.h"
+
+/**
+ * Sending datagrams through io_uring, see config::stream.io_uring
+ */
+namespace uring {
+  /**
+   * Queue the datagrams of send_info on the ring of the calling thread and submit them with a single syscall.
+   * The datagrams aren't copied, the ring holds on to send_info.owner until their completions are reaped by later calls.
+   * When the ring is full, it blocks until the kernel completes some of the requests.
+   *
+   * return the number of datagrams handed to the kernel, the caller has to send the remaining ones itself
+   * return -1 if io_uring isn't available, send_info has no owner or none could be handed to the kernel
+   */
+  int
+  send_batch(const platf::batched_send_info_t &send_info, const sockaddr *addr, socklen_t addr_len);
+}  // namespace uring
+
+#endif
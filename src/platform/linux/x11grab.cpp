@@ -5,6 +5,13 @@
 #include "src/platform/common.h"
 
 #include <fstream>
+#include <optional>
+
+#if defined(__x86_64__) || defined(__i386__)
+  #include <immintrin.h>
+#elif defined(__ARM_NEON)
+  #include <arm_neon.h>
+#endif
 
 #include <X11/X.h>
 #include <X11/Xlib.h>
@@ -59,6 +66,16 @@ namespace platf {
     _FN(CloseDisplay, int, (Display * display));
     _FN(Free, int, (void *data));
     _FN(InitThreads, Status, (void) );
+    _FN(QueryPointer, Bool,
+      (
+        Display * display,
+        Window w,
+        Window *root_return, Window *child_return,
+        int *root_x_return, int *root_y_return,
+        int *win_x_return, int *win_y_return,
+        unsigned int *mask_return));
+    _FN(EventsQueued, int, (Display * display, int mode));
+    _FN(NextEvent, int, (Display * display, XEvent *event_return));
 
     namespace rr {
       _FN(GetScreenResources, XRRScreenResources *, (Display * dpy, Window window));
@@ -102,6 +119,8 @@ namespace platf {
     }  // namespace rr
     namespace fix {
       _FN(GetCursorImage, XFixesCursorImage *, (Display * dpy));
+      _FN(QueryExtension, Bool, (Display * dpy, int *event_base_return, int *error_base_return));
+      _FN(SelectCursorInput, void, (Display * dpy, Window win, unsigned long eventMask));
 
       static int
       init() {
@@ -119,6 +138,8 @@ namespace platf {
 
         std::vector<std::tuple<dyn::apiproc *, const char *>> funcs {
           { (dyn::apiproc *) &GetCursorImage, "XFixesGetCursorImage" },
+          { (dyn::apiproc *) &QueryExtension, "XFixesQueryExtension" },
+          { (dyn::apiproc *) &SelectCursorInput, "XFixesSelectCursorInput" },
         };
 
         if (dyn::load(handle, funcs)) {
@@ -151,6 +172,9 @@ namespace platf {
         { (dyn::apiproc *) &Free, "XFree" },
         { (dyn::apiproc *) &CloseDisplay, "XCloseDisplay" },
         { (dyn::apiproc *) &InitThreads, "XInitThreads" },
+        { (dyn::apiproc *) &QueryPointer, "XQueryPointer" },
+        { (dyn::apiproc *) &EventsQueued, "XEventsQueued" },
+        { (dyn::apiproc *) &NextEvent, "XNextEvent" },
       };
 
       if (dyn::load(handle, funcs)) {
@@ -329,55 +353,299 @@ namespace platf {
     }
   };
 
-  static void
-  blend_cursor(Display *display, img_t &img, int offsetX, int offsetY) {
-    xcursor_t overlay { x11::fix::GetCursorImage(display) };
+  /**
+   * The cursor image as last fetched from the X server.
+   *
+   * The bitmap only changes when XFixes reports a new cursor_serial,
+   * so for most frames a position query is all that's needed.
+   */
+  struct cursor_cache_t {
+    Display *display {};
 
-    if (!overlay) {
-      BOOST_LOG(error) << "Couldn't get cursor from XFixesGetCursorImage"sv;
-      return;
+    // Set if the server sends XFixesCursorNotify events to this connection
+    bool notify {};
+    int event_base {};
+
+    bool valid {};
+    unsigned long serial {};
+
+    int x, y;
+    int xhot, yhot;
+    int width, height;
+
+    // Premultiplied ARGB
+    std::vector<std::uint32_t> pixels;
+
+    // Area covered by the cursor in the previous frame
+    std::optional<rect_t> last_rect;
+
+    void
+    init(Display *display) {
+      this->display = display;
+
+      valid = false;
+      last_rect.reset();
+
+      int error_base;
+      notify = x11::fix::QueryExtension(display, &event_base, &error_base);
+      if (notify) {
+        x11::fix::SelectCursorInput(display, DefaultRootWindow(display), XFixesDisplayCursorNotifyMask);
+      }
     }
 
-    overlay->x -= overlay->xhot;
-    overlay->y -= overlay->yhot;
+    int
+    fetch() {
+      xcursor_t overlay { x11::fix::GetCursorImage(display) };
 
-    overlay->x -= offsetX;
-    overlay->y -= offsetY;
+      if (!overlay) {
+        BOOST_LOG(error) << "Couldn't get cursor from XFixesGetCursorImage"sv;
+        return -1;
+      }
 
-    overlay->x = std::max((short) 0, overlay->x);
-    overlay->y = std::max((short) 0, overlay->y);
+      x = overlay->x;
+      y = overlay->y;
 
-    auto pixels = (int *) img.data;
+      if (valid && serial == overlay->cursor_serial) {
+        return 0;
+      }
 
-    auto screen_height = img.height;
-    auto screen_width = img.width;
+      xhot = overlay->xhot;
+      yhot = overlay->yhot;
+      width = overlay->width;
+      height = overlay->height;
 
-    auto delta_height = std::min<uint16_t>(overlay->height, std::max(0, screen_height - overlay->y));
-    auto delta_width = std::min<uint16_t>(overlay->width, std::max(0, screen_width - overlay->x));
-    for (auto y = 0; y < delta_height; ++y) {
-      auto overlay_begin = &overlay->pixels[y * overlay->width];
-      auto overlay_end = &overlay->pixels[y * overlay->width + delta_width];
+      // XFixes hands out the pixels as longs, convert them once per cursor
+      pixels.resize(width * height);
+      std::copy_n(overlay->pixels, pixels.size(), std::begin(pixels));
 
-      auto pixels_begin = &pixels[(y + overlay->y) * (img.row_pitch / img.pixel_pitch) + overlay->x];
+      serial = overlay->cursor_serial;
+      valid = true;
 
-      std::for_each(overlay_begin, overlay_end, [&](long pixel) {
-        int *pixel_p = (int *) &pixel;
+      return 0;
+    }
 
-        auto colors_in = (uint8_t *) pixels_begin;
+    /**
+     * Bring the cursor up to date.
+     * The image is refetched only if the cursor changed shape, otherwise only the position is queried.
+     */
+    int
+    refresh() {
+      if (!notify || !valid) {
+        return fetch();
+      }
 
-        auto alpha = (*(uint *) pixel_p) >> 24u;
-        if (alpha == 255) {
-          *pixels_begin = *pixel_p;
-        }
-        else {
-          auto colors_out = (uint8_t *) pixel_p;
-          colors_in[0] = colors_out[0] + (colors_in[0] * (255 - alpha) + 255 / 2) / 255;
-          colors_in[1] = colors_out[1] + (colors_in[1] * (255 - alpha) + 255 / 2) / 255;
-          colors_in[2] = colors_out[2] + (colors_in[2] * (255 - alpha) + 255 / 2) / 255;
+      // Events are read along with the replies of previous requests, no round trip is needed to check for them
+      bool changed = false;
+      while (x11::EventsQueued(display, QueuedAfterReading) > 0) {
+        XEvent event;
+        x11::NextEvent(display, &event);
+
+        if (event.type == event_base + XFixesCursorNotify) {
+          changed = true;
         }
-        ++pixels_begin;
-      });
+      }
+
+      if (changed) {
+        return fetch();
+      }
+
+      Window root, child;
+      int win_x, win_y;
+      unsigned int mask;
+      if (!x11::QueryPointer(display, DefaultRootWindow(display), &root, &child, &x, &y, &win_x, &win_y, &mask)) {
+        // Pointer is on another screen
+        return fetch();
+      }
+
+      return 0;
     }
+  };
+
+  // Round(a * b / 255) without a division, exact for 8-bit a and b
+  static inline std::uint32_t
+  mul_div255(std::uint32_t a, std::uint32_t b) {
+    auto t = a * b + 128;
+    return (t + (t >> 8)) >> 8;
+  }
+
+  // dst = src + dst * (255 - src.alpha) / 255, per channel
+  static void
+  blend_row_scalar(std::uint32_t *dst, const std::uint32_t *src, int count) {
+    for (int x = 0; x < count; ++x) {
+      auto pixel = src[x];
+      auto alpha = pixel >> 24;
+
+      if (alpha == 255) {
+        dst[x] = pixel;
+        continue;
+      }
+
+      if (!pixel) {
+        continue;
+      }
+
+      auto in = dst[x];
+      std::uint32_t out = 0;
+      for (int shift = 0; shift < 32; shift += 8) {
+        auto c = ((pixel >> shift) & 0xFF) + mul_div255((in >> shift) & 0xFF, 255 - alpha);
+        out |= std::min<std::uint32_t>(c, 255) << shift;
+      }
+      dst[x] = out;
+    }
+  }
+
+#if defined(__x86_64__) || defined(__i386__)
+  static inline __m128i
+  blend_sse2(__m128i s, __m128i d) {
+    auto zero = _mm_setzero_si128();
+    auto c255 = _mm_set1_epi16(255);
+    auto c128 = _mm_set1_epi16(128);
+
+    auto blend_half = [&](__m128i s16, __m128i d16) {
+      auto alpha = _mm_shufflehi_epi16(_mm_shufflelo_epi16(s16, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+      auto t = _mm_add_epi16(_mm_mullo_epi16(d16, _mm_sub_epi16(c255, alpha)), c128);
+      return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+    };
+
+    auto lo = blend_half(_mm_unpacklo_epi8(s, zero), _mm_unpacklo_epi8(d, zero));
+    auto hi = blend_half(_mm_unpackhi_epi8(s, zero), _mm_unpackhi_epi8(d, zero));
+
+    return _mm_adds_epu8(s, _mm_packus_epi16(lo, hi));
+  }
+
+  static void
+  blend_row_sse2(std::uint32_t *dst, const std::uint32_t *src, int count) {
+    int x = 0;
+    for (; x + 4 <= count; x += 4) {
+      auto s = _mm_loadu_si128((const __m128i *) (src + x));
+
+      // Most of a cursor bitmap is fully transparent
+      if (_mm_movemask_epi8(_mm_cmpeq_epi32(s, _mm_setzero_si128())) == 0xFFFF) {
+        continue;
+      }
+
+      auto d = _mm_loadu_si128((const __m128i *) (dst + x));
+      _mm_storeu_si128((__m128i *) (dst + x), blend_sse2(s, d));
+    }
+
+    blend_row_scalar(dst + x, src + x, count - x);
+  }
+
+  __attribute__((target("avx2"))) static void
+  blend_row_avx2(std::uint32_t *dst, const std::uint32_t *src, int count) {
+    auto zero = _mm256_setzero_si256();
+    auto c255 = _mm256_set1_epi16(255);
+    auto c128 = _mm256_set1_epi16(128);
+
+    int x = 0;
+    for (; x + 8 <= count; x += 8) {
+      auto s = _mm256_loadu_si256((const __m256i *) (src + x));
+
+      if (_mm256_movemask_epi8(_mm256_cmpeq_epi32(s, zero)) == -1) {
+        continue;
+      }
+
+      auto d = _mm256_loadu_si256((const __m256i *) (dst + x));
+
+      // Unpack and pack both work per 128-bit lane, so the pixel order is preserved
+      __m256i halves[2];
+      for (int h = 0; h < 2; ++h) {
+        auto s16 = h ? _mm256_unpackhi_epi8(s, zero) : _mm256_unpacklo_epi8(s, zero);
+        auto d16 = h ? _mm256_unpackhi_epi8(d, zero) : _mm256_unpacklo_epi8(d, zero);
+
+        auto alpha = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(s16, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+        auto t = _mm256_add_epi16(_mm256_mullo_epi16(d16, _mm256_sub_epi16(c255, alpha)), c128);
+        halves[h] = _mm256_srli_epi16(_mm256_add_epi16(t, _mm256_srli_epi16(t, 8)), 8);
+      }
+
+      _mm256_storeu_si256((__m256i *) (dst + x), _mm256_adds_epu8(s, _mm256_packus_epi16(halves[0], halves[1])));
+    }
+
+    blend_row_sse2(dst + x, src + x, count - x);
+  }
+#elif defined(__ARM_NEON)
+  static void
+  blend_row_neon(std::uint32_t *dst, const std::uint32_t *src, int count) {
+    int x = 0;
+    for (; x + 8 <= count; x += 8) {
+      auto s = vld4_u8((const std::uint8_t *) (src + x));
+      auto d = vld4_u8((const std::uint8_t *) (dst + x));
+
+      auto inv_alpha = vmvn_u8(s.val[3]);
+      for (int c = 0; c < 4; ++c) {
+        auto t = vmull_u8(d.val[c], inv_alpha);
+
+        // (t + 128 + ((t + 128) >> 8)) >> 8
+        d.val[c] = vqadd_u8(s.val[c], vraddhn_u16(t, vrshrq_n_u16(t, 8)));
+      }
+
+      vst4_u8((std::uint8_t *) (dst + x), d);
+    }
+
+    blend_row_scalar(dst + x, src + x, count - x);
+  }
+#endif
+
+  using blend_row_fn = void (*)(std::uint32_t *dst, const std::uint32_t *src, int count);
+
+  static blend_row_fn
+  select_blend_row() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+      return blend_row_avx2;
+    }
+    return blend_row_sse2;
+#elif defined(__ARM_NEON)
+    return blend_row_neon;
+#else
+    return blend_row_scalar;
+#endif
+  }
+
+  static void
+  blend_cursor(cursor_cache_t &cursor, Display *display, img_t &img, int offsetX, int offsetY) {
+    static const blend_row_fn blend_row = select_blend_row();
+
+    if (cursor.display != display) {
+      cursor.init(display);
+    }
+
+    if (cursor.refresh()) {
+      return;
+    }
+
+    auto cursor_x = cursor.x - cursor.xhot - offsetX;
+    auto cursor_y = cursor.y - cursor.yhot - offsetY;
+
+    // Clip the cursor against the image
+    auto x_begin = std::max(0, cursor_x);
+    auto y_begin = std::max(0, cursor_y);
+    auto x_end = std::min(img.width, cursor_x + cursor.width);
+    auto y_end = std::min(img.height, cursor_y + cursor.height);
+
+    std::optional<rect_t> rect;
+    if (x_begin < x_end && y_begin < y_end) {
+      rect = rect_t { x_begin, y_begin, x_end - x_begin, y_end - y_begin };
+
+      for (auto y = y_begin; y < y_end; ++y) {
+        auto src = &cursor.pixels[(y - cursor_y) * cursor.width + (x_begin - cursor_x)];
+        auto dst = (std::uint32_t *) (img.data + y * img.row_pitch) + x_begin;
+
+        blend_row(dst, src, x_end - x_begin);
+      }
+    }
+
+    // Both the old and the new location of the cursor changed
+    auto &last = cursor.last_rect;
+    if (last && (!rect || last->x != rect->x || last->y != rect->y || last->width != rect->width || last->height != rect->height)) {
+      img.damage.emplace_back(*last);
+    }
+    if (rect) {
+      img.damage.emplace_back(*rect);
+    }
+
+    cursor.last_rect = rect;
   }
 
   struct x11_attr_t: public display_t {
@@ -389,6 +657,8 @@ namespace platf {
 
     mem_type_e mem_type;
 
+    cursor_cache_t cursor_cache;
+
     /*
    * Last X (NOT the streamed monitor!) size.
    * This way we can trigger reinitialization if the dimensions changed while streaming
@@ -529,9 +799,10 @@ namespace platf {
       img_out->row_pitch = img->bytes_per_line;
       img_out->pixel_pitch = img->bits_per_pixel / 8;
       img_out->img.reset(img);
+      img_out->damage.clear();
 
       if (cursor) {
-        blend_cursor(xdisplay.get(), *img_out_base, offset_x, offset_y);
+        blend_cursor(cursor_cache, xdisplay.get(), *img_out_base, offset_x, offset_y);
       }
 
       return capture_e::ok;
@@ -646,9 +917,10 @@ namespace platf {
         }
 
         std::copy_n((std::uint8_t *) data.data, frame_size(), img->data);
+        img->damage.clear();
 
         if (cursor) {
-          blend_cursor(shm_xdisplay.get(), *img, offset_x, offset_y);
+          blend_cursor(cursor_cache, shm_xdisplay.get(), *img, offset_x, offset_y);
         }
 
         return capture_e::ok;
@@ -819,6 +1091,11 @@ namespace platf {
   }
 
   namespace x11 {
+    struct cursor_ctx_raw_t {
+      xdisplay_t display;
+      cursor_cache_t cache;
+    };
+
     std::optional<cursor_t>
     cursor_t::make() {
       if (load_x11()) {
@@ -827,42 +1104,47 @@ namespace platf {
 
       cursor_t cursor;
 
-      cursor.ctx.reset((cursor_ctx_t::pointer) x11::OpenDisplay(nullptr));
+      cursor.ctx.reset(new cursor_ctx_raw_t);
+      cursor.ctx->display.reset(x11::OpenDisplay(nullptr));
 
       return cursor;
     }
 
     void
     cursor_t::capture(egl::cursor_t &img) {
-      auto display = (xdisplay_t::pointer) ctx.get();
+      auto &cache = ctx->cache;
 
-      xcursor_t xcursor = fix::GetCursorImage(display);
+      if (cache.display != ctx->display.get()) {
+        cache.init(ctx->display.get());
+      }
+
+      if (cache.refresh()) {
+        return;
+      }
 
-      if (img.serial != xcursor->cursor_serial) {
-        auto buf_size = xcursor->width * xcursor->height * sizeof(int);
+      if (img.serial != cache.serial) {
+        auto buf_size = cache.pixels.size() * sizeof(int);
 
         if (img.buffer.size() < buf_size) {
           img.buffer.resize(buf_size);
         }
 
-        std::transform(xcursor->pixels, xcursor->pixels + buf_size / 4, (int *) img.buffer.data(), [](long pixel) -> int {
-          return pixel;
-        });
+        std::copy(std::begin(cache.pixels), std::end(cache.pixels), (std::uint32_t *) img.buffer.data());
       }
 
       img.data = img.buffer.data();
-      img.width = xcursor->width;
-      img.height = xcursor->height;
-      img.x = xcursor->x - xcursor->xhot;
-      img.y = xcursor->y - xcursor->yhot;
+      img.width = cache.width;
+      img.height = cache.height;
+      img.x = cache.x - cache.xhot;
+      img.y = cache.y - cache.yhot;
       img.pixel_pitch = 4;
       img.row_pitch = img.pixel_pitch * img.width;
-      img.serial = xcursor->cursor_serial;
+      img.serial = cache.serial;
     }
 
     void
     cursor_t::blend(img_t &img, int offsetX, int offsetY) {
-      blend_cursor((xdisplay_t::pointer) ctx.get(), img, offsetX, offsetY);
+      blend_cursor(ctx->cache, ctx->display.get(), img, offsetX, offsetY);
     }
 
     xdisplay_t
@@ -877,7 +1159,7 @@ namespace platf {
 
     void
     freeCursorCtx(cursor_ctx_t::pointer ctx) {
-      CloseDisplay((xdisplay_t::pointer) ctx);
+      delete ctx;
     }
   }  // namespace x11
 }  // namespace platf
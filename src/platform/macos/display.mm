@@ -1,3 +1,5 @@
+#include <sys/sysctl.h>
+
 #include "src/platform/common.h"
 #include "src/platform/macos/av_img_t.h"
 #include "src/platform/macos/av_video.h"
@@ -207,4 +209,14 @@ namespace platf {
 
     return display_names;
   }
+
+  std::string
+  gpu_identity() {
+    // The GPU is part of the model, its drivers are part of the system
+    char model[256] {};
+    auto size = sizeof(model) - 1;
+    sysctlbyname("hw.model", model, &size, nullptr, 0);
+
+    return std::string { model } + ':' + [NSProcessInfo processInfo].operatingSystemVersionString.UTF8String;
+  }
 }  // namespace platf
@@ -183,6 +183,11 @@ namespace platf {
     // Unimplemented
   }
 
+  void
+  adjust_thread_affinity(thread_role_e role) {
+    // macOS doesn't let threads be pinned to CPUs
+  }
+
   void
   streaming_will_start() {
     // Nothing to do
@@ -211,6 +216,18 @@ namespace platf {
     return false;
   }
 
+  bool
+  send_batch(multi_send_info_t &send_info) {
+    // Fall back to unbatched send calls
+    return false;
+  }
+
+  std::int64_t
+  send_queue_bytes(std::uintptr_t native_socket, std::size_t datagram_size) {
+    // Unimplemented
+    return -1;
+  }
+
   std::unique_ptr<deinit_t>
   enable_socket_qos(uintptr_t native_socket, boost::asio::ip::address &address, uint16_t port, qos_data_type_e data_type) {
     // Unimplemented
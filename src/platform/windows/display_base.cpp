@@ -5,6 +5,7 @@
 #include <cmath>
 #include <codecvt>
 #include <initguid.h>
+#include <sstream>
 
 #include <boost/process.hpp>
 
@@ -924,4 +925,41 @@ namespace platf {
     return display_names;
   }
 
+  std::string
+  gpu_identity() {
+    // Enumerating the adapters counts as calling DXGI
+    if (!dxgi::probe_for_gpu_preference(config::video.output_name)) {
+      BOOST_LOG(warning) << "Failed to set GPU preference. Capture may not work!"sv;
+    }
+
+    dxgi::factory1_t factory;
+    auto status = CreateDXGIFactory1(IID_IDXGIFactory1, (void **) &factory);
+    if (FAILED(status)) {
+      BOOST_LOG(error) << "Failed to create DXGIFactory1 [0x"sv << util::hex(status).to_string_view() << ']';
+      return {};
+    }
+
+    std::wstring_convert<std::codecvt_utf8_utf16<wchar_t>, wchar_t> converter;
+    std::stringstream ss;
+
+    dxgi::adapter_t adapter;
+    for (int x = 0; factory->EnumAdapters1(x, &adapter) != DXGI_ERROR_NOT_FOUND; ++x) {
+      DXGI_ADAPTER_DESC1 adapter_desc;
+      adapter->GetDesc1(&adapter_desc);
+
+      // The version of the user mode driver
+      LARGE_INTEGER driver_version {};
+      adapter->CheckInterfaceSupport(__uuidof(IDXGIDevice), &driver_version);
+
+      ss << converter.to_bytes(adapter_desc.Description) << ':'
+         << util::hex(adapter_desc.VendorId).to_string_view() << ':'
+         << util::hex(adapter_desc.DeviceId).to_string_view() << ':'
+         << util::hex(adapter_desc.SubSysId).to_string_view() << ':'
+         << util::hex(adapter_desc.Revision).to_string_view() << ':'
+         << driver_version.QuadPart << ',';
+    }
+
+    return ss.str();
+  }
+
 }  // namespace platf
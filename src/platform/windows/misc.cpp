@@ -21,6 +21,7 @@
 #include <ws2tcpip.h>
 // clang-format on
 
+#include "src/config.h"
 #include "src/main.h"
 #include "src/platform/common.h"
 #include "src/utility.h"
@@ -589,6 +590,27 @@ namespace platf {
     }
   }
 
+  void
+  adjust_thread_affinity(thread_role_e role) {
+    auto &cpus = config::cpu_affinity(role);
+    if (cpus.empty()) {
+      return;
+    }
+
+    // Only the CPUs of the current processor group can be used
+    DWORD_PTR mask = 0;
+    for (auto cpu : cpus) {
+      if (cpu < sizeof(DWORD_PTR) * 8) {
+        mask |= (DWORD_PTR) 1 << cpu;
+      }
+    }
+
+    if (!mask || !SetThreadAffinityMask(GetCurrentThread(), mask)) {
+      auto winerr = GetLastError();
+      BOOST_LOG(warning) << "Unable to set thread affinity: "sv << winerr;
+    }
+  }
+
   void
   streaming_will_start() {
     static std::once_flag load_wlanapi_once_flag;
@@ -809,6 +831,18 @@ namespace platf {
     return WSASendMsg((SOCKET) send_info.native_socket, &msg, 1, &bytes_sent, nullptr, nullptr) != SOCKET_ERROR;
   }
 
+  bool
+  send_batch(multi_send_info_t &send_info) {
+    // Windows can only batch datagrams of the same size, fall back to unbatched send calls
+    return false;
+  }
+
+  std::int64_t
+  send_queue_bytes(std::uintptr_t native_socket, std::size_t datagram_size) {
+    // Windows only reports the send backlog of TCP sockets
+    return -1;
+  }
+
   class qos_t: public deinit_t {
   public:
     qos_t(QOS_FLOWID flow_id):
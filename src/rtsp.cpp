@@ -19,6 +19,7 @@ extern "C" {
 #include "rtsp.h"
 #include "stream.h"
 #include "sync.h"
+#include "video.h"
 
 #include <unordered_map>
 
@@ -488,6 +489,9 @@ namespace rtsp_stream {
     auto seqn_str = std::to_string(req->sequenceNumber);
     option.content = const_cast<char *>(seqn_str.c_str());
 
+    // HEVC support is only known once the encoders are probed
+    video::wait_for_init();
+
     std::stringstream ss;
     if (config::video.hevc_mode != 1) {
       ss << "sprop-parameter-sets=AAAAAU"sv << std::endl;
@@ -690,6 +694,7 @@ namespace rtsp_stream {
       }
     }
 
+    video::wait_for_init();
     if (config.monitor.videoFormat != 0 && config::video.hevc_mode == 1) {
       BOOST_LOG(warning) << "HEVC is disabled, yet the client requested HEVC"sv;
 
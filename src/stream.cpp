@@ -181,7 +181,6 @@ namespace stream {
   using rh_t = util::safe_ptr<reed_solomon, reed_solomon_release>;
   using video_packet_t = util::c_ptr<video_packet_raw_t>;
   using audio_packet_t = util::c_ptr<audio_packet_raw_t>;
-  using audio_fec_packet_t = util::c_ptr<audio_fec_packet_raw_t>;
   using audio_aes_t = std::array<char, round_to_pkcs7_padded(MAX_AUDIO_PACKET_SIZE)>;
 
   using message_queue_t = std::shared_ptr<safe::queue_t<std::pair<std::uint16_t, std::string>>>;
@@ -210,15 +209,115 @@ namespace stream {
     }
   }
 
+  /**
+   * Wakes up the control thread while it waits for ENet, so messages queued by other threads go out right away.
+   * A datagram sent to a socket on the loopback interface makes the socket readable.
+   */
+  class waker_t {
+  public:
+    int
+    open() {
+      boost::system::error_code ec;
+
+      sock.open(udp::v4(), ec);
+      if (!ec) {
+        sock.bind(udp::endpoint { asio::ip::address_v4::loopback(), 0 }, ec);
+      }
+      if (!ec) {
+        sock.non_blocking(true, ec);
+      }
+      if (!ec) {
+        endpoint = sock.local_endpoint(ec);
+      }
+      if (!ec) {
+        sender.open(udp::v4(), ec);
+      }
+
+      if (ec) {
+        BOOST_LOG(warning) << "Couldn't open the wake up socket of the control server: "sv << ec.message();
+
+        sock.close(ec);
+        return -1;
+      }
+
+      return 0;
+    }
+
+    /**
+     * Safe to call from any thread
+     */
+    void
+    wake() {
+      // A wake up is already pending
+      if (!sock.is_open() || woken.exchange(true)) {
+        return;
+      }
+
+      std::lock_guard lg { send_lock };
+
+      char byte = 0;
+      boost::system::error_code ec;
+      sender.send_to(asio::buffer(&byte, 1), endpoint, 0, ec);
+    }
+
+    /**
+     * Called by the control thread once it is awake, before it handles the queued messages
+     */
+    void
+    reset() {
+      woken = false;
+
+      boost::system::error_code ec;
+      while (sock.is_open() && sock.available(ec) && !ec) {
+        char byte;
+        sock.receive(asio::buffer(&byte, 1), 0, ec);
+      }
+    }
+
+    /**
+     * The socket that becomes readable on wake()
+     */
+    udp::socket &
+    socket() {
+      return sock;
+    }
+
+  private:
+    asio::io_service io;
+
+    udp::socket sock { io };
+    udp::socket sender { io };
+    udp::endpoint endpoint;
+    std::mutex send_lock;
+
+    std::atomic_bool woken {};
+  };
+
   class control_server_t {
   public:
     int
     bind(std::uint16_t port) {
       _host = net::host_create(_addr, config::stream.channels, port);
 
+      // Without it, the control thread notices queued messages on its next timeout
+      _waker->open();
+
       return !(bool) _host;
     }
 
+    /**
+     * Make the control thread send the queued messages of the sessions right away
+     */
+    void
+    wake() {
+      _waker->wake();
+    }
+
+    std::shared_ptr<waker_t>
+    waker() {
+      return _waker;
+    }
+
     void
     emplace_addr_to_session(const std::string &addr, session_t &session) {
       auto lg = _map_addr_session.lock();
@@ -273,6 +372,32 @@ namespace stream {
 
     ENetAddress _addr;
     net::host_t _host;
+
+    std::shared_ptr<waker_t> _waker = std::make_shared<waker_t>();
+
+  private:
+    /**
+     * Block until a datagram arrives for ENet, wake() is called or the timeout expires
+     */
+    void
+    wait(std::chrono::milliseconds timeout);
+  };
+
+  /**
+   * Sends the video of the sessions assigned to it
+   * The sockets of all workers are bound to the video port with SO_REUSEPORT
+   */
+  struct video_worker_t {
+    explicit video_worker_t(asio::io_service &io):
+        sock { io } {}
+
+    udp::socket sock;
+    std::thread thread;
+
+    std::shared_ptr<safe::queue_t<video::packet_t>> packets;
+
+    // The number of sessions assigned to this worker
+    std::atomic_int sessions {};
   };
 
   struct broadcast_ctx_t {
@@ -280,12 +405,11 @@ namespace stream {
 
     std::thread recv_thread;
     std::thread video_thread;
-    std::thread audio_thread;
     std::thread control_thread;
 
     asio::io_service io;
 
-    udp::socket video_sock { io };
+    std::vector<std::unique_ptr<video_worker_t>> video_workers;
     udp::socket audio_sock { io };
 
     // This is purely for administrative purposes.
@@ -297,6 +421,62 @@ namespace stream {
     control_server_t control_server;
   };
 
+  /**
+   * Tracks the bytes still queued on the video socket when the next frame of a session is ready to be sent.
+   * A backlog of a frame or more means the local network can't keep up with the bitrate:
+   * the latency grows before the client notices any loss.
+   */
+  class send_queue_t {
+  public:
+    // The size of a frame at the bitrate of the session, including FEC
+    std::int64_t frame_bytes = 0;
+
+    bool congested = false;
+
+    /**
+     * queued <-- The bytes on the socket that haven't been sent yet
+     */
+    void
+    record(std::int64_t queued) {
+      average += (queued - average) / 8;
+
+      ++samples;
+      total += queued;
+      peak = std::max(peak, queued);
+
+      if (!congested && average > frame_bytes) {
+        congested = true;
+        ++congestions;
+
+        BOOST_LOG(info) << "Video send queue is backing up: "sv << (std::int64_t) average / 1024 << " KiB queued"sv;
+      }
+      else if (congested && average < frame_bytes / 2) {
+        congested = false;
+
+        BOOST_LOG(info) << "Video send queue drained"sv;
+      }
+    }
+
+    void
+    log_stats() const {
+      if (!samples) {
+        return;
+      }
+
+      BOOST_LOG(info) << "Video send queue: "sv << total / samples / 1024 << " KiB queued on average, "sv
+                      << peak / 1024 << " KiB at peak, backed up "sv << congestions << " times"sv;
+    }
+
+  private:
+    double average = 0;
+
+    // Statistics
+    std::int64_t samples = 0;
+    std::int64_t total = 0;
+    std::int64_t peak = 0;
+    int congestions = 0;
+  };
+
   struct session_t {
     config_t config;
 
@@ -316,6 +496,9 @@ namespace stream {
       udp::endpoint peer;
       safe::mail_raw_t::event_t<bool> idr_events;
       std::unique_ptr<platf::deinit_t> qos;
+
+      video_worker_t *worker;
+      send_queue_t send_queue;
     } video;
 
     struct {
@@ -330,7 +513,9 @@ namespace stream {
       util::buffer_t<char> shards;
       util::buffer_t<uint8_t *> shards_p;
 
-      audio_fec_packet_t fec_packet;
+      // The parity shards are encoded straight into the payload of these packets
+      util::buffer_t<char> fec_packets;
+      std::array<audio_fec_packet_raw_t *, RTPA_FEC_SHARDS> fec_packets_p;
       std::unique_ptr<platf::deinit_t> qos;
     } audio;
 
@@ -343,6 +528,13 @@ namespace stream {
 
       platf::rumble_queue_t rumble_queue;
       safe::mail_raw_t::event_t<video::hdr_info_t> hdr_queue;
+
+      // The messages sent to the client
+      struct {
+        std::uint64_t sent;
+        std::uint64_t coalesced;
+        std::uint64_t dropped;
+      } stats;
     } control;
 
     safe::mail_raw_t::event_t<bool> shutdown_event;
@@ -442,10 +634,37 @@ namespace stream {
     }
   }
 
+  void
+  control_server_t::wait(std::chrono::milliseconds timeout) {
+    ENetSocketSet set;
+    ENET_SOCKETSET_EMPTY(set);
+
+    auto max_socket = _host->socket;
+    ENET_SOCKETSET_ADD(set, _host->socket);
+
+    if (_waker->socket().is_open()) {
+      auto wake_socket = (ENetSocket) _waker->socket().native_handle();
+
+      max_socket = std::max(max_socket, wake_socket);
+      ENET_SOCKETSET_ADD(set, wake_socket);
+    }
+
+    enet_socketset_select(max_socket, &set, nullptr, timeout.count());
+
+    _waker->reset();
+  }
+
   void
   control_server_t::iterate(std::chrono::milliseconds timeout) {
     ENetEvent event;
-    auto res = enet_host_service(_host.get(), &event, timeout.count());
+
+    // Handle what ENet has pending and send the queued packets before waiting
+    auto res = enet_host_service(_host.get(), &event, 0);
+    if (res == 0) {
+      wait(timeout);
+
+      res = enet_host_service(_host.get(), &event, 0);
+    }
 
     if (res > 0) {
       auto session = get_session(event.peer);
@@ -492,16 +711,16 @@ namespace stream {
       size_t percentage;
 
       size_t blocksize;
-      util::buffer_t<char> shards;
+      std::shared_ptr<util::buffer_t<char>> shards;
 
       char *
       data(size_t el) {
-        return &shards[el * blocksize];
+        return &(*shards)[el * blocksize];
       }
 
       std::string_view
       operator[](size_t el) const {
-        return { &shards[el * blocksize], blocksize };
+        return { &(*shards)[el * blocksize], blocksize };
       }
 
       size_t
@@ -510,8 +729,42 @@ namespace stream {
       }
     };
 
+    /**
+     * Recycles the buffers holding the shards of the video frames.
+     * A buffer is only reused once nobody else holds on to it,
+     * a buffer sent with MSG_ZEROCOPY is kept by the platform until the kernel is done with it.
+     */
+    class shard_pool_t {
+    public:
+      // Enough for the FEC blocks of a few frames in flight
+      static constexpr std::size_t MAX_BUFFERS = 16;
+
+      std::shared_ptr<util::buffer_t<char>>
+      take(size_t size) {
+        for (auto &buffer : buffers) {
+          if (buffer.use_count() == 1) {
+            if (buffer->size() < size) {
+              *buffer = util::buffer_t<char> { size };
+            }
+
+            return buffer;
+          }
+        }
+
+        auto buffer = std::make_shared<util::buffer_t<char>>(size);
+        if (buffers.size() < MAX_BUFFERS) {
+          buffers.emplace_back(buffer);
+        }
+
+        return buffer;
+      }
+
+    private:
+      std::vector<std::shared_ptr<util::buffer_t<char>>> buffers;
+    };
+
     static fec_t
-    encode(const std::string_view &payload, size_t blocksize, size_t fecpercentage, size_t minparityshards) {
+    encode(shard_pool_t &pool, const std::string_view &payload, size_t blocksize, size_t fecpercentage, size_t minparityshards) {
       auto payload_size = payload.size();
 
       auto pad = payload_size % blocksize != 0;
@@ -538,15 +791,16 @@ namespace stream {
         fecpercentage = 0;
       }
 
-      util::buffer_t<char> shards { nr_shards * blocksize };
+      // A recycled buffer may be larger than needed
+      auto shards = pool.take(nr_shards * blocksize);
       util::buffer_t<uint8_t *> shards_p { nr_shards };
 
       // copy payload + padding
-      auto next = std::copy(std::begin(payload), std::end(payload), std::begin(shards));
-      std::fill(next, std::end(shards), 0);  // padding with zero
+      auto next = std::copy(std::begin(payload), std::end(payload), shards->begin());
+      std::fill(next, shards->begin() + nr_shards * blocksize, 0);  // padding with zero
 
       for (auto x = 0; x < nr_shards; ++x) {
-        shards_p[x] = (uint8_t *) &shards[x * blocksize];
+        shards_p[x] = (uint8_t *) &(*shards)[x * blocksize];
       }
 
       if (data_shards + parity_shards <= DATA_SHARDS_MAX) {
@@ -815,9 +1069,14 @@ namespace stream {
 
     // This thread handles latency-sensitive control messages
     platf::adjust_thread_priority(platf::thread_priority_e::critical);
+    platf::adjust_thread_affinity(platf::thread_role_e::control);
+
+    // The latest state of each gamepad
+    std::vector<platf::rumble_t> rumbles;
 
     auto shutdown_event = mail::man->event<bool>(mail::broadcast_shutdown);
     while (!shutdown_event->peek()) {
+      bool flush = false;
       {
         auto lg = server->_map_addr_session.lock();
 
@@ -843,11 +1102,34 @@ namespace stream {
             continue;
           }
 
+          auto &stats = session->control.stats;
+
+          // Games may update force feedback faster than it's worth sending, only the latest state counts
+          rumbles.clear();
           auto &rumble_queue = session->control.rumble_queue;
           while (rumble_queue->peek()) {
             auto rumble = rumble_queue->pop();
 
-            send_rumble(session, rumble->id, rumble->lowfreq, rumble->highfreq);
+            auto it = std::find_if(std::begin(rumbles), std::end(rumbles), [&](auto &prev) {
+              return prev.id == rumble->id;
+            });
+            if (it != std::end(rumbles)) {
+              *it = *rumble;
+              ++stats.coalesced;
+            }
+            else {
+              rumbles.emplace_back(*rumble);
+            }
+          }
+
+          for (auto &rumble : rumbles) {
+            if (send_rumble(session, rumble.id, rumble.lowfreq, rumble.highfreq)) {
+              ++stats.dropped;
+            }
+            else {
+              ++stats.sent;
+              flush = true;
+            }
           }
 
           // Unlike rumble which we send as best-effort, HDR state messages are critical
@@ -857,13 +1139,24 @@ namespace stream {
           while (session->control.peer && hdr_queue->peek()) {
             auto hdr_info = hdr_queue->pop();
 
-            send_hdr_mode(session, std::move(hdr_info));
+            if (send_hdr_mode(session, std::move(hdr_info))) {
+              ++stats.dropped;
+            }
+            else {
+              ++stats.sent;
+              flush = true;
+            }
           }
 
           ++pos;
         })
       }
 
+      // ENet packs the messages queued for a peer into as few datagrams as possible
+      if (flush) {
+        server->flush();
+      }
+
       if (proc::proc.running() == 0) {
         BOOST_LOG(debug) << "Process terminated"sv;
 
@@ -909,7 +1202,6 @@ namespace stream {
     std::map<asio::ip::address, message_queue_t> peer_to_video_session;
     std::map<asio::ip::address, message_queue_t> peer_to_audio_session;
 
-    auto &video_sock = ctx.video_sock;
     auto &audio_sock = ctx.audio_sock;
 
     auto &message_queue_queue = ctx.message_queue_queue;
@@ -917,10 +1209,16 @@ namespace stream {
 
     auto &io = ctx.io;
 
-    udp::endpoint peer;
+    struct receiver_t {
+      udp::endpoint peer;
 
-    std::array<char, 2048> buf[2];
-    std::function<void(const boost::system::error_code, size_t)> recv_func[2];
+      std::array<char, 2048> buf;
+      std::function<void(const boost::system::error_code, size_t)> recv_func;
+    };
+
+    // The kernel spreads the pings over the sockets of the video workers
+    // The last receiver is for audio
+    std::vector<receiver_t> receivers(ctx.video_workers.size() + 1);
 
     auto populate_peer_to_session = [&]() {
       while (message_queue_queue->peek()) {
@@ -948,13 +1246,13 @@ namespace stream {
       }
     };
 
-    auto recv_func_init = [&](udp::socket &sock, int buf_elem, std::map<asio::ip::address, message_queue_t> &peer_to_session) {
-      recv_func[buf_elem] = [&, buf_elem](const boost::system::error_code &ec, size_t bytes) {
+    auto recv_func_init = [&](udp::socket &sock, receiver_t &receiver, std::string_view type_str, std::map<asio::ip::address, message_queue_t> &peer_to_session) {
+      receiver.recv_func = [&, type_str](const boost::system::error_code &ec, size_t bytes) {
+        auto &peer = receiver.peer;
         auto fg = util::fail_guard([&]() {
-          sock.async_receive_from(asio::buffer(buf[buf_elem]), peer, 0, recv_func[buf_elem]);
+          sock.async_receive_from(asio::buffer(receiver.buf), peer, 0, receiver.recv_func);
         });
 
-        auto type_str = buf_elem ? "AUDIO"sv : "VIDEO"sv;
         BOOST_LOG(verbose) << "Recv: "sv << peer.address().to_string() << ':' << peer.port() << " :: " << type_str;
 
         populate_peer_to_session();
@@ -972,30 +1270,52 @@ namespace stream {
         auto it = peer_to_session.find(peer.address());
         if (it != std::end(peer_to_session)) {
           BOOST_LOG(debug) << "RAISE: "sv << peer.address().to_string() << ':' << peer.port() << " :: " << type_str;
-          it->second->raise(peer.port(), std::string { buf[buf_elem].data(), bytes });
+          it->second->raise(peer.port(), std::string { receiver.buf.data(), bytes });
         }
       };
-    };
 
-    recv_func_init(video_sock, 0, peer_to_video_session);
-    recv_func_init(audio_sock, 1, peer_to_audio_session);
+      sock.async_receive_from(asio::buffer(receiver.buf), receiver.peer, 0, receiver.recv_func);
+    };
 
-    video_sock.async_receive_from(asio::buffer(buf[0]), peer, 0, recv_func[0]);
-    audio_sock.async_receive_from(asio::buffer(buf[1]), peer, 0, recv_func[1]);
+    for (std::size_t x = 0; x < ctx.video_workers.size(); ++x) {
+      recv_func_init(ctx.video_workers[x]->sock, receivers[x], "VIDEO"sv, peer_to_video_session);
+    }
+    recv_func_init(audio_sock, receivers.back(), "AUDIO"sv, peer_to_audio_session);
 
     while (!broadcast_shutdown_event->peek()) {
       io.run();
     }
   }
 
+  /**
+   * Hand the video packets to the workers of their sessions
+   * Only used with more than one video worker
+   */
   void
-  videoBroadcastThread(udp::socket &sock) {
-    auto shutdown_event = mail::man->event<bool>(mail::broadcast_shutdown);
+  videoDispatchThread(broadcast_ctx_t &ctx) {
     auto packets = mail::man->queue<video::packet_t>(mail::video_packets);
+
+    while (auto packet = packets->pop()) {
+      auto session = (session_t *) packet->channel_data;
+
+      session->video.worker->packets->raise(std::move(packet));
+    }
+
+    for (auto &worker : ctx.video_workers) {
+      worker->packets->stop();
+    }
+  }
+
+  void
+  videoBroadcastThread(udp::socket &sock, std::shared_ptr<safe::queue_t<video::packet_t>> packets) {
+    auto shutdown_event = mail::man->event<bool>(mail::broadcast_shutdown);
     auto timebase = boost::posix_time::microsec_clock::universal_time();
 
+    fec::shard_pool_t shard_pool;
+
     // Video traffic is sent on this thread
     platf::adjust_thread_priority(platf::thread_priority_e::high);
+    platf::adjust_thread_affinity(platf::thread_role_e::video_send);
 
     while (auto packet = packets->pop()) {
       if (shutdown_event->peek()) {
@@ -1005,6 +1325,12 @@ namespace stream {
       auto session = (session_t *) packet->channel_data;
       auto lowseq = session->video.lowseq;
 
+      // Whatever the previous frames left queued delays this one
+      auto queued = platf::send_queue_bytes(sock.native_handle(), session->config.packetsize + MAX_RTP_HEADER_SIZE);
+      if (queued >= 0) {
+        session->video.send_queue.record(queued);
+      }
+
       auto av_packet = packet->av_packet;
       std::string_view payload { (char *) av_packet->data, (size_t) av_packet->size };
       std::vector<uint8_t> payload_new;
@@ -1102,7 +1428,7 @@ namespace stream {
             }
           }
 
-          auto shards = fec::encode(current_payload, blocksize, fecPercentage, session->config.minRequiredFecPackets);
+          auto shards = fec::encode(shard_pool, current_payload, blocksize, fecPercentage, session->config.minRequiredFecPackets);
 
           // set FEC info now that we know for sure what our percentage will be for this frame
           for (auto x = 0; x < shards.size(); ++x) {
@@ -1127,7 +1453,7 @@ namespace stream {
 
           auto peer_address = session->video.peer.address();
           auto batch_info = platf::batched_send_info_t {
-            shards.shards.begin(),
+            shards.shards->begin(),
             shards.blocksize,
             shards.nr_shards,
             (uintptr_t) sock.native_handle(),
@@ -1135,6 +1461,12 @@ namespace stream {
             session->video.peer.port(),
           };
 
+          // Copying large frames into the kernel costs more than pinning their pages.
+          // io_uring reads the shards after send_batch() returns, whatever their size.
+          if (config::stream.io_uring || (config::stream.zerocopy_threshold && av_packet->size >= config::stream.zerocopy_threshold)) {
+            batch_info.owner = shards.shards;
+          }
+
           // Use a batched send if it's supported on this platform
           if (!platf::send_batch(batch_info)) {
             // Batched send is not available, so send each packet individually
@@ -1166,10 +1498,13 @@ namespace stream {
     shutdown_event->raise(true);
   }
 
+  /**
+   * Encrypts and sends the audio of a single session,
+   * so that sessions don't have to wait on each other.
+   */
   void
-  audioBroadcastThread(udp::socket &sock) {
-    auto shutdown_event = mail::man->event<bool>(mail::broadcast_shutdown);
-    auto packets = mail::man->queue<audio::packet_t>(mail::audio_packets);
+  audioSendThread(session_t *session, safe::mail_raw_t::queue_t<audio::packet_t> packets) {
+    auto &sock = session->broadcast_ref->audio_sock;
 
     constexpr auto max_block_size = crypto::cipher::round_to_pkcs7_padded(2048);
 
@@ -1190,14 +1525,16 @@ namespace stream {
 
     // Audio traffic is sent on this thread
     platf::adjust_thread_priority(platf::thread_priority_e::high);
+    platf::adjust_thread_affinity(platf::thread_role_e::audio);
 
-    while (auto packet = packets->pop()) {
-      if (shutdown_event->peek()) {
-        break;
-      }
+    auto &shards_p = session->audio.shards_p;
+    auto &fec_packets = session->audio.fec_packets_p;
+
+    // The last data packet of a FEC block is sent together with its parity shards
+    std::array<std::string_view, 1 + RTPA_FEC_SHARDS> datagrams;
 
-      TUPLE_2D_REF(channel_data, packet_data, *packet);
-      auto session = (session_t *) channel_data;
+    while (auto packet = packets->pop()) {
+      auto &packet_data = packet->second;
 
       auto sequenceNumber = session->audio.sequenceNumber;
       auto timestamp = session->audio.timestamp;
@@ -1209,6 +1546,7 @@ namespace stream {
       auto bytes = encode_audio(session->config.featureFlags, packet_data, audio_packet, session->audio.avRiKeyId, session->audio.cipher);
       if (bytes < 0) {
         BOOST_LOG(error) << "Couldn't encode audio packet"sv;
+        session::stop(*session);
         break;
       }
 
@@ -1218,41 +1556,97 @@ namespace stream {
       session->audio.sequenceNumber++;
       session->audio.timestamp += session->config.audio.packetDuration;
 
-      auto &shards_p = session->audio.shards_p;
-
       std::copy_n(audio_packet->payload(), bytes, shards_p[sequenceNumber % RTPA_DATA_SHARDS]);
-      try {
-        sock.send_to(asio::buffer((char *) audio_packet.get(), sizeof(audio_packet_raw_t) + bytes), session->audio.peer);
 
-        BOOST_LOG(verbose) << "Audio ["sv << sequenceNumber << "] ::  send..."sv;
-
-        auto &fec_packet = session->audio.fec_packet;
-        // initialize the FEC header at the beginning of the FEC block
-        if (sequenceNumber % RTPA_DATA_SHARDS == 0) {
+      // initialize the FEC header at the beginning of the FEC block
+      if (sequenceNumber % RTPA_DATA_SHARDS == 0) {
+        for (auto fec_packet : fec_packets) {
           fec_packet->fecHeader.baseSequenceNumber = util::endian::big(sequenceNumber);
           fec_packet->fecHeader.baseTimestamp = util::endian::big(timestamp);
         }
+      }
+
+      datagrams[0] = std::string_view { (char *) audio_packet.get(), sizeof(audio_packet_raw_t) + bytes };
+      std::size_t datagram_count = 1;
 
-        // generate parity shards at the end of the FEC block
-        if ((sequenceNumber + 1) % RTPA_DATA_SHARDS == 0) {
-          reed_solomon_encode(rs.get(), shards_p.begin(), RTPA_TOTAL_SHARDS, bytes);
+      // generate parity shards at the end of the FEC block
+      if ((sequenceNumber + 1) % RTPA_DATA_SHARDS == 0) {
+        reed_solomon_encode(rs.get(), shards_p.begin(), RTPA_TOTAL_SHARDS, bytes);
 
-          for (auto x = 0; x < RTPA_FEC_SHARDS; ++x) {
-            fec_packet->rtp.sequenceNumber = util::endian::big<std::uint16_t>(sequenceNumber + x + 1);
-            fec_packet->fecHeader.fecShardIndex = x;
-            memcpy(fec_packet->payload(), shards_p[RTPA_DATA_SHARDS + x], bytes);
-            sock.send_to(asio::buffer((char *) fec_packet.get(), sizeof(audio_fec_packet_raw_t) + bytes), session->audio.peer);
-            BOOST_LOG(verbose) << "Audio FEC ["sv << (sequenceNumber & ~(RTPA_DATA_SHARDS - 1)) << ' ' << x << "] ::  send..."sv;
+        for (auto x = 0; x < RTPA_FEC_SHARDS; ++x) {
+          fec_packets[x]->rtp.sequenceNumber = util::endian::big<std::uint16_t>(sequenceNumber + x + 1);
+          datagrams[datagram_count++] = std::string_view { (char *) fec_packets[x], sizeof(audio_fec_packet_raw_t) + bytes };
+        }
+      }
+
+      try {
+        auto peer_address = session->audio.peer.address();
+        platf::multi_send_info_t send_info {
+          datagrams.data(),
+          datagram_count,
+          (uintptr_t) sock.native_handle(),
+          peer_address,
+          session->audio.peer.port(),
+        };
+
+        if (datagram_count == 1 || !platf::send_batch(send_info)) {
+          for (std::size_t x = 0; x < datagram_count; ++x) {
+            sock.send_to(asio::buffer(datagrams[x].data(), datagrams[x].size()), session->audio.peer);
           }
         }
+
+        BOOST_LOG(verbose) << "Audio ["sv << sequenceNumber << "] ::  send..."sv;
+        for (std::size_t x = 1; x < datagram_count; ++x) {
+          BOOST_LOG(verbose) << "Audio FEC ["sv << (sequenceNumber & ~(RTPA_DATA_SHARDS - 1)) << ' ' << x - 1 << "] ::  send..."sv;
+        }
       }
       catch (const std::exception &e) {
         BOOST_LOG(error) << "Broadcast audio failed "sv << e.what();
         std::this_thread::sleep_for(100ms);
       }
     }
+  }
 
-    shutdown_event->raise(true);
+  /**
+   * Grow the send buffer of a video socket to hold a burst of key frames at the bitrate of the session.
+   * Sessions sharing the socket never shrink it.
+   */
+  static void
+  size_send_buffer(udp::socket &sock, const config_t &config) {
+    // A key frame can be many times the size of an average frame, 100 ms of video covers it
+    std::int64_t bytes = (std::int64_t) config.monitor.bitrate * 1000 / 8 / 10;
+    bytes = bytes * (100 + config::stream.fec_percentage) / 100;
+    bytes = std::max<std::int64_t>(bytes, 64 * (config.packetsize + MAX_RTP_HEADER_SIZE));
+    bytes = std::min<std::int64_t>(bytes, std::numeric_limits<int>::max() / 2);
+
+#ifdef __linux__
+    // Linux doubles the requested size to make room for its bookkeeping and reports the doubled value
+    constexpr std::int64_t reported_factor = 2;
+#else
+    constexpr std::int64_t reported_factor = 1;
+#endif
+
+    boost::system::error_code ec;
+    asio::socket_base::send_buffer_size size;
+    sock.get_option(size, ec);
+    if (!ec && size.value() >= bytes * reported_factor) {
+      return;
+    }
+
+    sock.set_option(asio::socket_base::send_buffer_size { (int) bytes }, ec);
+    if (ec) {
+      BOOST_LOG(warning) << "Couldn't set the send buffer of the video socket: "sv << ec.message();
+      return;
+    }
+
+    // The system may limit the size, e.g. net.core.wmem_max on Linux
+    sock.get_option(size, ec);
+    if (!ec && size.value() < bytes * reported_factor) {
+      BOOST_LOG(warning) << "Video send buffer is limited to "sv << size.value() / reported_factor / 1024 << " KiB, "sv << bytes / 1024 << " KiB requested"sv;
+    }
+    else {
+      BOOST_LOG(debug) << "Video send buffer: "sv << bytes / 1024 << " KiB"sv;
+    }
   }
 
   int
@@ -1267,19 +1661,42 @@ namespace stream {
       return -1;
     }
 
+    auto video_workers = config::stream.video_workers;
+#ifndef SO_REUSEPORT
+    if (video_workers > 1) {
+      BOOST_LOG(warning) << "SO_REUSEPORT isn't supported on this platform, sending video with a single worker"sv;
+      video_workers = 1;
+    }
+#endif
+
     boost::system::error_code ec;
-    ctx.video_sock.open(udp::v4(), ec);
-    if (ec) {
-      BOOST_LOG(fatal) << "Couldn't open socket for Video server: "sv << ec.message();
+    for (int x = 0; x < video_workers; ++x) {
+      auto &worker = ctx.video_workers.emplace_back(std::make_unique<video_worker_t>(ctx.io));
 
-      return -1;
-    }
+      worker->sock.open(udp::v4(), ec);
+      if (ec) {
+        BOOST_LOG(fatal) << "Couldn't open socket for Video server: "sv << ec.message();
 
-    ctx.video_sock.bind(udp::endpoint(udp::v4(), video_port), ec);
-    if (ec) {
-      BOOST_LOG(fatal) << "Couldn't bind Video server to port ["sv << video_port << "]: "sv << ec.message();
+        return -1;
+      }
 
-      return -1;
+#ifdef SO_REUSEPORT
+      if (video_workers > 1) {
+        worker->sock.set_option(asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT> { true }, ec);
+        if (ec) {
+          BOOST_LOG(fatal) << "Couldn't set SO_REUSEPORT on socket for Video server: "sv << ec.message();
+
+          return -1;
+        }
+      }
+#endif
+
+      worker->sock.bind(udp::endpoint(udp::v4(), video_port), ec);
+      if (ec) {
+        BOOST_LOG(fatal) << "Couldn't bind Video server to port ["sv << video_port << "]: "sv << ec.message();
+
+        return -1;
+      }
     }
 
     ctx.audio_sock.open(udp::v4(), ec);
@@ -1298,8 +1715,21 @@ namespace stream {
 
     ctx.message_queue_queue = std::make_shared<message_queue_queue_t::element_type>(30);
 
-    ctx.video_thread = std::thread { videoBroadcastThread, std::ref(ctx.video_sock) };
-    ctx.audio_thread = std::thread { audioBroadcastThread, std::ref(ctx.audio_sock) };
+    if (ctx.video_workers.size() == 1) {
+      // Send straight from the queue of the encoders
+      auto &worker = ctx.video_workers.front();
+
+      worker->packets = mail::man->queue<video::packet_t>(mail::video_packets);
+      worker->thread = std::thread { videoBroadcastThread, std::ref(worker->sock), worker->packets };
+    }
+    else {
+      for (auto &worker : ctx.video_workers) {
+        worker->packets = std::make_shared<safe::queue_t<video::packet_t>>(30);
+        worker->thread = std::thread { videoBroadcastThread, std::ref(worker->sock), worker->packets };
+      }
+
+      ctx.video_thread = std::thread { videoDispatchThread, std::ref(ctx) };
+    }
     ctx.control_thread = std::thread { controlBroadcastThread, &ctx.control_server };
 
     ctx.recv_thread = std::thread { recvThread, std::ref(ctx) };
@@ -1312,29 +1742,34 @@ namespace stream {
     auto broadcast_shutdown_event = mail::man->event<bool>(mail::broadcast_shutdown);
 
     broadcast_shutdown_event->raise(true);
+    ctx.control_server.wake();
 
     auto video_packets = mail::man->queue<video::packet_t>(mail::video_packets);
-    auto audio_packets = mail::man->queue<audio::packet_t>(mail::audio_packets);
 
-    // Minimize delay stopping video/audio threads
+    // Minimize delay stopping video threads
     video_packets->stop();
-    audio_packets->stop();
 
     ctx.message_queue_queue->stop();
     ctx.io.stop();
 
-    ctx.video_sock.close();
+    for (auto &worker : ctx.video_workers) {
+      worker->packets->stop();
+      worker->sock.close();
+    }
     ctx.audio_sock.close();
 
     video_packets.reset();
-    audio_packets.reset();
 
     BOOST_LOG(debug) << "Waiting for main listening thread to end..."sv;
     ctx.recv_thread.join();
     BOOST_LOG(debug) << "Waiting for main video thread to end..."sv;
-    ctx.video_thread.join();
-    BOOST_LOG(debug) << "Waiting for main audio thread to end..."sv;
-    ctx.audio_thread.join();
+    if (ctx.video_thread.joinable()) {
+      ctx.video_thread.join();
+    }
+    for (auto &worker : ctx.video_workers) {
+      worker->thread.join();
+    }
+    ctx.video_workers.clear();
     BOOST_LOG(debug) << "Waiting for main control thread to end..."sv;
     ctx.control_thread.join();
     BOOST_LOG(debug) << "All broadcasting threads ended"sv;
@@ -1426,10 +1861,19 @@ namespace stream {
       return;
     }
 
+    // Spread the sessions over the video workers
+    auto worker = std::min_element(std::begin(ref->video_workers), std::end(ref->video_workers), [](auto &l, auto &r) {
+      return l->sessions < r->sessions;
+    });
+    ++(*worker)->sessions;
+    session->video.worker = worker->get();
+
+    size_send_buffer(session->video.worker->sock, session->config);
+
     // Enable QoS tagging on video traffic if requested by the client
     if (session->config.videoQosType) {
       auto address = session->video.peer.address();
-      session->video.qos = std::move(platf::enable_socket_qos(ref->video_sock.native_handle(), address,
+      session->video.qos = std::move(platf::enable_socket_qos(session->video.worker->sock.native_handle(), address,
         session->video.peer.port(), platf::qos_data_type_e::video));
     }
 
@@ -1458,6 +1902,14 @@ namespace stream {
         session->audio.peer.port(), platf::qos_data_type_e::audio));
     }
 
+    // The encoded audio of this session is sent by its own thread
+    auto packets = session->mail->queue<audio::packet_t>(mail::audio_packets);
+    std::thread send_thread { audioSendThread, session, packets };
+    auto send_fg = util::fail_guard([&]() {
+      packets->stop();
+      send_thread.join();
+    });
+
     BOOST_LOG(debug) << "Start capturing Audio"sv;
     audio::capture(session->mail, session->config.audio, session);
   }
@@ -1500,10 +1952,19 @@ namespace stream {
 
       BOOST_LOG(debug) << "Waiting for video to end..."sv;
       session.videoThread.join();
+      if (session.video.worker) {
+        --session.video.worker->sessions;
+      }
+      session.video.send_queue.log_stats();
       BOOST_LOG(debug) << "Waiting for audio to end..."sv;
       session.audioThread.join();
       BOOST_LOG(debug) << "Waiting for control to end..."sv;
       session.controlEnd.view();
+
+      auto &control_stats = session.control.stats;
+      BOOST_LOG(info) << "Control: sent "sv << control_stats.sent << " messages, coalesced "sv << control_stats.coalesced
+                      << " rumble updates, dropped "sv << control_stats.dropped;
+
       // Reset input on session stop to avoid stuck repeated keys
       BOOST_LOG(debug) << "Resetting Input..."sv;
       input::reset(session.input);
@@ -1562,6 +2023,15 @@ namespace stream {
 
       session.broadcast_ref->control_server.emplace_addr_to_session(addr_string, session);
 
+      // Messages for the client and stopping the session don't wait for the next timeout of the control thread
+      // The hooks hold on to the waker, the queues may outlive the broadcast
+      auto wake = [waker = session.broadcast_ref->control_server.waker()]() {
+        waker->wake();
+      };
+      session.control.rumble_queue->on_raise = wake;
+      session.control.hdr_queue->on_raise = wake;
+      session.shutdown_event->on_raise = wake;
+
       auto addr = boost::asio::ip::make_address(addr_string);
       session.video.peer.address(addr);
       session.video.peer.port(0);
@@ -1613,30 +2083,46 @@ namespace stream {
 
       session->video.idr_events = mail->event<bool>(mail::idr);
       session->video.lowseq = 0;
+      session->video.worker = nullptr;
+
+      auto &monitor = config.monitor;
+      session->video.send_queue.frame_bytes =
+        (std::int64_t) monitor.bitrate * 1000 / 8 / monitor.framerate * (100 + config::stream.fec_percentage) / 100;
 
       constexpr auto max_block_size = crypto::cipher::round_to_pkcs7_padded(2048);
 
-      util::buffer_t<char> shards { RTPA_TOTAL_SHARDS * max_block_size };
+      util::buffer_t<char> shards { RTPA_DATA_SHARDS * max_block_size };
       util::buffer_t<uint8_t *> shards_p { RTPA_TOTAL_SHARDS };
 
-      for (auto x = 0; x < RTPA_TOTAL_SHARDS; ++x) {
+      for (auto x = 0; x < RTPA_DATA_SHARDS; ++x) {
         shards_p[x] = (uint8_t *) &shards[x * max_block_size];
       }
 
+      // The FEC packets lie back to back, the parity shards are their payloads
+      constexpr auto fec_packet_size = sizeof(audio_fec_packet_raw_t) + max_block_size;
+      util::buffer_t<char> fec_packets { RTPA_FEC_SHARDS * fec_packet_size };
+
+      for (auto x = 0; x < RTPA_FEC_SHARDS; ++x) {
+        auto fec_packet = (audio_fec_packet_raw_t *) &fec_packets[x * fec_packet_size];
+
+        fec_packet->rtp.header = 0x80;
+        fec_packet->rtp.packetType = 127;
+        fec_packet->rtp.timestamp = 0;
+        fec_packet->rtp.ssrc = 0;
+
+        fec_packet->fecHeader.fecShardIndex = x;
+        fec_packet->fecHeader.payloadType = 97;
+        fec_packet->fecHeader.ssrc = 0;
+
+        shards_p[RTPA_DATA_SHARDS + x] = fec_packet->payload();
+        session->audio.fec_packets_p[x] = fec_packet;
+      }
+
       // Audio FEC spans multiple audio packets,
       // therefore its session specific
       session->audio.shards = std::move(shards);
       session->audio.shards_p = std::move(shards_p);
-
-      session->audio.fec_packet.reset((audio_fec_packet_raw_t *) malloc(sizeof(audio_fec_packet_raw_t) + max_block_size));
-
-      session->audio.fec_packet->rtp.header = 0x80;
-      session->audio.fec_packet->rtp.packetType = 127;
-      session->audio.fec_packet->rtp.timestamp = 0;
-      session->audio.fec_packet->rtp.ssrc = 0;
-
-      session->audio.fec_packet->fecHeader.payloadType = 97;
-      session->audio.fec_packet->fecHeader.ssrc = 0;
+      session->audio.fec_packets = std::move(fec_packets);
 
       session->audio.cipher = crypto::cipher::cbc_t {
         gcm_key, true
@@ -1647,6 +2133,7 @@ namespace stream {
       session->audio.timestamp = 0;
 
       session->control.peer = nullptr;
+      session->control.stats = {};
       session->state.store(state_e::STOPPED, std::memory_order_relaxed);
 
       session->mail = std::move(mail);
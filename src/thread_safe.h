@@ -475,8 +475,22 @@ namespace safe {
     post_t(mail_t mail, Args &&...args):
         T(std::forward<Args>(args)...), mail { std::move(mail) } {}
 
+    template <class... Args>
+    void
+    raise(Args &&...args) {
+      T::raise(std::forward<Args>(args)...);
+
+      if (on_raise) {
+        on_raise();
+      }
+    }
+
     mail_t mail;
 
+    // Called after every raise(), e.g. to wake up a thread waiting on something else
+    // Must be set before the post is shared with other threads
+    std::function<void()> on_raise;
+
     ~post_t() {
       cleanup(mail.get());
     }
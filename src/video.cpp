@@ -1,22 +1,44 @@
 // Created by loki on 6/6/19.
 
+#include <algorithm>
+#include <array>
 #include <atomic>
 #include <bitset>
+#include <cmath>
+#include <fstream>
+#include <future>
+#include <sstream>
 #include <thread>
+#include <tuple>
+
+#include <boost/property_tree/json_parser.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+#ifdef __linux__
+  #include <sys/utsname.h>
+#endif
 
 extern "C" {
+#include <libavutil/avutil.h>
+#include <libavutil/imgutils.h>
 #include <libavutil/mastering_display_metadata.h>
+#include <libavutil/opt.h>
+#include <libavutil/pixdesc.h>
 #include <libswscale/swscale.h>
 }
 
+#include "capture_trace.h"
 #include "cbs.h"
 #include "config.h"
+#include "frame_hash.h"
 #include "input.h"
 #include "main.h"
 #include "platform/common.h"
-#include "round_robin.h"
 #include "sync.h"
+#include "thread_pool.h"
+#include "version.h"
 #include "video.h"
+#include "video_convert.h"
 
 #ifdef _WIN32
 extern "C" {
@@ -96,34 +118,170 @@ namespace video {
   int
   hwframe_ctx(ctx_t &ctx, platf::hwdevice_t *hwdevice, buffer_t &hwdevice_ctx, AVPixelFormat format);
 
-  class swdevice_t: public platf::hwdevice_t {
+  /**
+   * Colour conversion of a frame is split across the threads of this pool, one horizontal band per task.
+   * It's shared by all sessions.
+   */
+  static thread_pool_util::ThreadPool &
+  convert_pool() {
+    static thread_pool_util::ThreadPool pool { (int) std::max(std::thread::hardware_concurrency() / 2, 1u) };
+
+    return pool;
+  }
+
+  /**
+   * Sessions converting the same captured image to the same format share the result.
+   * The first session to need a conversion performs it, the others reference the planes of its frame.
+   *
+   * A session writing into shared planes must make its frame writable first, which is what swdevice_t does anyway.
+   */
+  class convert_cache_t {
   public:
-    int
-    convert(platf::img_t &img) override {
-      av_frame_make_writable(sw_frame.get());
+    // width, height, pixel format, colorspace, color range
+    using key_t = std::tuple<int, int, int, std::uint32_t, std::uint32_t>;
 
-      const int linesizes[2] {
-        img.row_pitch, 0
-      };
+    enum class status_e {
+      hit,  // The frame now references the converted planes
+      convert,  // The caller must convert the image, then call end()
+      bypass,  // The caller must convert the image, without calling end()
+    };
 
-      std::uint8_t *data[4];
+    /**
+     * sequence <-- platf::img_t::sequence of the image to convert
+     */
+    status_e
+    begin(const key_t &key, std::uint64_t sequence, AVFrame *frame) {
+      std::unique_lock ul { lock };
+
+      auto &entry = entries[key];
 
-      data[0] = sw_frame->data[0] + offsetY;
-      if (sw_frame->format == AV_PIX_FMT_NV12) {
-        data[1] = sw_frame->data[1] + offsetUV * 2;
-        data[2] = nullptr;
+      // Another session is converting this very image
+      done.wait(ul, [&]() { return !(entry.sequence == sequence && entry.converting); });
+
+      if (entry.sequence == sequence && entry.frame) {
+        return share_planes(frame, entry.frame.get()) ? status_e::bypass : status_e::hit;
       }
-      else {
-        data[1] = sw_frame->data[1] + offsetUV;
-        data[2] = sw_frame->data[2] + offsetUV;
-        data[3] = nullptr;
+
+      // This session is behind the others
+      if (entry.sequence > sequence) {
+        return status_e::bypass;
       }
 
-      int ret = sws_scale(sws.get(), (std::uint8_t *const *) &img.data, linesizes, 0, img.height, data, sw_frame->linesize);
-      if (ret <= 0) {
-        BOOST_LOG(error) << "Couldn't convert image to required format and/or size"sv;
+      entry.sequence = sequence;
+      entry.converting = true;
+      entry.frame.reset();
 
-        return -1;
+      return status_e::convert;
+    }
+
+    /**
+     * frame <-- The converted frame, nullptr if the conversion failed
+     */
+    void
+    end(const key_t &key, std::uint64_t sequence, const AVFrame *frame) {
+      std::lock_guard lg { lock };
+
+      auto &entry = entries[key];
+      if (entry.sequence != sequence) {
+        return;
+      }
+
+      entry.converting = false;
+      if (frame) {
+        entry.frame.reset(av_frame_alloc());
+        if (share_planes(entry.frame.get(), frame)) {
+          entry.frame.reset();
+        }
+      }
+
+      // Formats nobody converted to for a while
+      for (auto it = std::begin(entries); it != std::end(entries);) {
+        if (!it->second.converting && it->second.sequence + 60 < sequence) {
+          it = entries.erase(it);
+        }
+        else {
+          ++it;
+        }
+      }
+
+      done.notify_all();
+    }
+
+  private:
+    /**
+     * Make dst reference the planes of src, without touching its other properties or side data
+     */
+    static int
+    share_planes(AVFrame *dst, const AVFrame *src) {
+      dst->width = src->width;
+      dst->height = src->height;
+      dst->format = src->format;
+
+      for (int x = 0; x < AV_NUM_DATA_POINTERS; ++x) {
+        av_buffer_unref(&dst->buf[x]);
+        dst->data[x] = nullptr;
+        dst->linesize[x] = 0;
+
+        if (src->buf[x]) {
+          dst->buf[x] = av_buffer_ref(src->buf[x]);
+          if (!dst->buf[x]) {
+            return -1;
+          }
+        }
+
+        dst->data[x] = src->data[x];
+        dst->linesize[x] = src->linesize[x];
+      }
+
+      return 0;
+    }
+
+    struct entry_t {
+      std::uint64_t sequence {};
+      bool converting {};
+      frame_t frame;
+    };
+
+    std::mutex lock;
+    std::condition_variable done;
+    std::map<key_t, entry_t> entries;
+  };
+
+  static convert_cache_t &
+  convert_cache() {
+    static convert_cache_t cache;
+
+    return cache;
+  }
+
+  class swdevice_t: public platf::hwdevice_t {
+  public:
+    /**
+     * Rows converted by a dedicated kernel, relative to the top of the picture inside the padding
+     */
+    struct band_t {
+      int y;
+      int height;
+    };
+
+    int
+    convert(platf::img_t &img) override {
+      convert_cache_t::key_t key { sw_frame->width, sw_frame->height, sw_frame->format, colorspace, color_range };
+
+      // Images without a sequence number aren't shared between sessions
+      auto status = img.sequence ? convert_cache().begin(key, img.sequence, sw_frame.get()) : convert_cache_t::status_e::bypass;
+      if (status != convert_cache_t::status_e::hit) {
+        auto ret = convert_bands(img);
+
+        if (status == convert_cache_t::status_e::convert) {
+          convert_cache().end(key, img.sequence, ret ? nullptr : sw_frame.get());
+        }
+
+        if (ret) {
+          BOOST_LOG(error) << "Couldn't convert image to required format and/or size"sv;
+
+          return -1;
+        }
       }
 
       // If frame is not a software frame, it means we still need to transfer from main memory
@@ -140,6 +298,76 @@ namespace video {
       return 0;
     }
 
+    int
+    convert_bands(platf::img_t &img) {
+      // The planes may be shared with other sessions or still referenced by the encoder
+      if (av_frame_make_writable(sw_frame.get())) {
+        return -1;
+      }
+
+      if (!kernel) {
+        return scale(img);
+      }
+
+      // The calling thread converts the first band while the pool takes care of the others
+      for (auto it = std::begin(bands) + 1; it != std::end(bands); ++it) {
+        pending.emplace_back(convert_pool().push([this, &img, band = &*it]() {
+          return convert_band(img, *band);
+        }));
+      }
+
+      auto ret = convert_band(img, bands.front());
+      for (auto &future : pending) {
+        if (future.get()) {
+          ret = -1;
+        }
+      }
+      pending.clear();
+
+      return ret;
+    }
+
+    int
+    convert_band(platf::img_t &img, band_t &band) {
+      std::uint8_t *data[4];
+      plane_pointers(sw_frame.get(), offsetW, offsetH + band.y, data);
+
+      kernel(coefficients, img.data + band.y * img.row_pitch, img.row_pitch, data, sw_frame->linesize, img.width, band.height);
+
+      return 0;
+    }
+
+    /**
+     * Convert the whole image with swscale, split over its slice threads
+     */
+    int
+    scale(platf::img_t &img) {
+      // sws_scale_frame() would copy an image without a buffer, it only borrows the captured one
+      frame_t src { av_frame_alloc() };
+      src->buf[0] = av_buffer_create(img.data, img.row_pitch * img.height, [](void *, std::uint8_t *) {}, nullptr, AV_BUFFER_FLAG_READONLY);
+      if (!src->buf[0]) {
+        return -1;
+      }
+
+      src->data[0] = img.data;
+      src->linesize[0] = img.row_pitch;
+      src->width = img.width;
+      src->height = img.height;
+      src->format = AV_PIX_FMT_BGR0;
+
+      // The picture inside the padding
+      frame_t dst { av_frame_alloc() };
+      if (av_frame_ref(dst.get(), sw_frame.get())) {
+        return -1;
+      }
+
+      dst->width = out_width;
+      dst->height = out_height;
+      plane_pointers(sw_frame.get(), offsetW, offsetH, dst->data);
+
+      return sws_scale_frame(sws.get(), dst.get(), src.get()) < 0 ? -1 : 0;
+    }
+
     int
     set_frame(AVFrame *frame, AVBufferRef *hw_frames_ctx) {
       this->frame = frame;
@@ -159,10 +387,39 @@ namespace video {
 
     void
     set_colorspace(std::uint32_t colorspace, std::uint32_t color_range) override {
-      sws_setColorspaceDetails(sws.get(),
-        sws_getCoefficients(SWS_CS_DEFAULT), 0,
-        sws_getCoefficients(colorspace), color_range - 1,
-        0, 1 << 16, 1 << 16);
+      this->colorspace = colorspace;
+      this->color_range = color_range;
+
+      if (kernel) {
+        color_t *color_p;
+        switch (colorspace) {
+          case SWS_CS_SMPTE170M:
+            color_p = &colors[0];
+            break;
+          case SWS_CS_ITU709:
+            color_p = &colors[2];
+            break;
+          case SWS_CS_BT2020:
+            color_p = &colors[4];
+            break;
+          default:
+            color_p = &colors[0];
+        }
+
+        if (color_range > 1) {
+          // Full range
+          ++color_p;
+        }
+
+        coefficients = convert::make_coefficients(*color_p, kernel_bits);
+      }
+
+      if (sws) {
+        sws_setColorspaceDetails(sws.get(),
+          sws_getCoefficients(SWS_CS_DEFAULT), 0,
+          sws_getCoefficients(colorspace), color_range - 1,
+          0, 1 << 16, 1 << 16);
+      }
     }
 
     /**
@@ -225,27 +482,142 @@ namespace video {
         return -1;
       }
 
-      auto out_width = frame->width;
-      auto out_height = frame->height;
+      out_width = frame->width;
+      out_height = frame->height;
 
       // Ensure aspect ratio is maintained
       auto scalar = std::fminf((float) out_width / in_width, (float) out_height / in_height);
       out_width = in_width * scalar;
       out_height = in_height * scalar;
 
-      // result is always positive
-      auto offsetW = (frame->width - out_width) / 2;
-      auto offsetH = (frame->height - out_height) / 2;
-      offsetUV = (offsetW + offsetH * frame->width / 2) / 2;
-      offsetY = offsetW + offsetH * frame->width;
+      // result is always positive, and kept even so chroma planes line up
+      offsetW = (frame->width - out_width) / 4 * 2;
+      offsetH = (frame->height - out_height) / 4 * 2;
+
+      auto flags = scaling_flags(in_width, in_height, out_width, out_height);
+
+      // Without scaling, the dedicated kernels are a lot cheaper than swscale
+      if (in_width == out_width && in_height == out_height && config::video.convert_quality != "quality"sv) {
+        if (auto kernel_format = convert_format(format)) {
+          kernel = convert::kernel(*kernel_format);
+          kernel_bits = *kernel_format == convert::format_e::p010 || *kernel_format == convert::format_e::yuv420p10 ? 10 : 8;
+        }
+      }
+
+      auto threads = convert_threads(out_height);
+
+      if (!kernel) {
+        // The filters of swscale reach across the edges of independent bands, scaled or subsampled rows would show seams.
+        // A single context splits the picture over its own slice threads instead.
+        BOOST_LOG(debug) << "Scaling "sv << in_width << 'x' << in_height << " to "sv << out_width << 'x' << out_height << " with "sv << threads << " threads"sv;
+
+        sws.reset(sws_alloc_context());
+        if (!sws) {
+          return -1;
+        }
+
+        av_opt_set_int(sws.get(), "srcw", in_width, 0);
+        av_opt_set_int(sws.get(), "srch", in_height, 0);
+        av_opt_set_int(sws.get(), "src_format", AV_PIX_FMT_BGR0, 0);
+        av_opt_set_int(sws.get(), "dstw", out_width, 0);
+        av_opt_set_int(sws.get(), "dsth", out_height, 0);
+        av_opt_set_int(sws.get(), "dst_format", format, 0);
+        av_opt_set_int(sws.get(), "sws_flags", flags, 0);
+        av_opt_set_int(sws.get(), "threads", threads, 0);
+
+        return sws_init_context(sws.get(), nullptr, nullptr) < 0 ? -1 : 0;
+      }
+
+      // The kernels convert each 2x2 block on its own, bands starting on an even row are independent
+      auto units = std::max(out_height / 2, 1);
+      auto band_count = std::clamp(threads, 1, units);
+
+      BOOST_LOG(debug) << "Converting "sv << in_width << 'x' << in_height << " in "sv << band_count << " bands"sv;
 
-      sws.reset(sws_getContext(
-        in_width, in_height, AV_PIX_FMT_BGR0,
-        out_width, out_height, format,
-        SWS_LANCZOS | SWS_ACCURATE_RND,
-        nullptr, nullptr, nullptr));
+      bands.resize(band_count);
+      for (int x = 0; x < band_count; ++x) {
+        auto &band = bands[x];
 
-      return sws ? 0 : -1;
+        band.y = x * units / band_count * 2;
+
+        auto end = x + 1 == band_count ? out_height : (x + 1) * units / band_count * 2;
+        band.height = end - band.y;
+      }
+
+      return 0;
+    }
+
+    /**
+     * Lanczos is only worth its cost when downscaling, unless the user asked for it.
+     */
+    static int
+    scaling_flags(int in_width, int in_height, int out_width, int out_height) {
+      auto &quality = config::video.convert_quality;
+
+      if (quality == "quality"sv) {
+        return SWS_LANCZOS | SWS_ACCURATE_RND;
+      }
+
+      bool scaling = in_width != out_width || in_height != out_height;
+      if (quality == "fast"sv) {
+        return scaling ? SWS_FAST_BILINEAR : SWS_POINT;
+      }
+
+      bool downscaling = out_width < in_width || out_height < in_height;
+      return downscaling ? SWS_LANCZOS : SWS_BILINEAR;
+    }
+
+    static std::optional<convert::format_e>
+    convert_format(AVPixelFormat format) {
+      switch (format) {
+        case AV_PIX_FMT_NV12:
+          return convert::format_e::nv12;
+        case AV_PIX_FMT_YUV420P:
+          return convert::format_e::yuv420p;
+        case AV_PIX_FMT_P010:
+          return convert::format_e::p010;
+        case AV_PIX_FMT_YUV420P10:
+          return convert::format_e::yuv420p10;
+        default:
+          return std::nullopt;
+      }
+    }
+
+    static int
+    convert_threads(int out_height) {
+      if (config::video.convert_threads > 0) {
+        return config::video.convert_threads;
+      }
+
+      // Roughly 270 rows per band, 4 bands at 1080p.
+      // A second band on a single core only adds the cost of handing it over.
+      auto cores = (int) std::max(std::thread::hardware_concurrency(), 1u);
+      auto pool_threads = std::max(cores / 2, 1);
+      return std::max(std::min({ pool_threads + 1, cores, out_height / 270 }), 1);
+    }
+
+    /**
+     * Pointers to the pixel at (x, y) in each plane of the frame
+     */
+    static void
+    plane_pointers(AVFrame *frame, int x, int y, std::uint8_t *data[4]) {
+      auto desc = av_pix_fmt_desc_get((AVPixelFormat) frame->format);
+
+      int steps[4];
+      av_image_fill_max_pixsteps(steps, nullptr, desc);
+
+      for (int plane = 0; plane < 4; ++plane) {
+        if (!frame->data[plane]) {
+          data[plane] = nullptr;
+          continue;
+        }
+
+        bool chroma = plane == 1 || plane == 2;
+        auto plane_x = chroma ? x >> desc->log2_chroma_w : x;
+        auto plane_y = chroma ? y >> desc->log2_chroma_h : y;
+
+        data[plane] = frame->data[plane] + plane_y * frame->linesize[plane] + plane_x * steps[plane];
+      }
     }
 
     ~swdevice_t() override {}
@@ -254,11 +626,28 @@ namespace video {
     frame_t hw_frame;
 
     frame_t sw_frame;
+
+    // Replaced by bands when a dedicated kernel converts
     sws_t sws;
 
+    std::vector<band_t> bands;
+    std::vector<std::future<int>> pending;
+
+    std::uint32_t colorspace {};
+    std::uint32_t color_range {};
+
+    // Replaces swscale when set
+    convert::kernel_t kernel {};
+    convert::coefficients_t coefficients {};
+    int kernel_bits;
+
     // offset of input image to output frame in pixels
-    int offsetUV;
-    int offsetY;
+    int offsetW;
+    int offsetH;
+
+    // size of the picture inside the padding
+    int out_width;
+    int out_height;
   };
 
   enum flag_e {
@@ -378,7 +767,8 @@ namespace video {
     ctx_t ctx;
     std::shared_ptr<platf::hwdevice_t> device;
 
-    std::vector<packet_raw_t::replace_t> replacements;
+    // Copied on write, packets still in flight keep the previous version
+    packet_raw_t::replacements_t replacements { std::make_shared<std::vector<packet_raw_t::replace_t>>() };
 
     cbs::nal_t sps;
     cbs::nal_t vps;
@@ -405,6 +795,8 @@ namespace video {
 
     platf::img_t *img_tmp;
     session_t session;
+
+    std::chrono::steady_clock::time_point last_encode;
   };
 
   using encode_session_ctx_queue_t = safe::queue_t<sync_session_ctx_t>;
@@ -742,6 +1134,152 @@ namespace video {
     }
   }
 
+  /**
+   * Recognizes a captured image identical to the previous one, e.g. a static menu or a paused game.
+   * Such an image needn't be converted and encoded again.
+   * Only images in system memory are checked, the others are never considered duplicates.
+   */
+  class duplicate_filter_t {
+  public:
+    bool
+    is_duplicate(const platf::img_t &img) {
+      if (!img.data) {
+        return false;
+      }
+
+      auto hash = frame_hash::hash(img);
+      bool duplicate = prev_hash && *prev_hash == hash;
+      prev_hash = hash;
+
+      return duplicate;
+    }
+
+    /**
+     * The next image is never a duplicate, for when someone hasn't seen the previous one
+     */
+    void
+    reset() {
+      prev_hash.reset();
+    }
+
+  private:
+    std::optional<std::uint64_t> prev_hash;
+  };
+
+  /**
+   * The images the capture thread hands out to the encoders.
+   * An image returns to the pool when the last encoder drops it, which wakes up the capture thread if it's waiting for one.
+   *
+   * Images are allocated on demand, up to a limit set by the capture thread from the number of encoders.
+   * Free images past that limit are deallocated.
+   */
+  class img_pool_t {
+    struct state_t {
+      std::mutex lock;
+      std::condition_variable released;
+
+      // Every image of the pool, whether it's free or not
+      std::vector<std::shared_ptr<platf::img_t>> owned;
+      std::vector<platf::img_t *> free;
+
+      // Once closed, images are deallocated as soon as they're released
+      bool closed {};
+    };
+
+  public:
+    explicit img_pool_t(platf::display_t *disp):
+        disp { disp }, state { std::make_shared<state_t>() } {}
+
+    img_pool_t(const img_pool_t &) = delete;
+    img_pool_t &
+    operator=(const img_pool_t &) = delete;
+
+    /**
+     * Get a free image, waiting for one to be released if limit images are already in use.
+     * return nullptr if an image couldn't be allocated
+     */
+    std::shared_ptr<platf::img_t>
+    acquire(std::size_t limit) {
+      std::unique_lock ul { state->lock };
+
+      while (state->owned.size() > limit && !state->free.empty()) {
+        erase_owned(state->free.back());
+        state->free.pop_back();
+      }
+
+      if (state->free.empty() && state->owned.size() < limit) {
+        ul.unlock();
+        auto img = disp->alloc_img();
+        ul.lock();
+
+        if (!img) {
+          BOOST_LOG(error) << "Couldn't initialize an image"sv;
+          return nullptr;
+        }
+
+        state->free.emplace_back(img.get());
+        state->owned.emplace_back(std::move(img));
+      }
+
+      state->released.wait(ul, [this]() { return !state->free.empty(); });
+
+      auto img = state->free.back();
+      state->free.pop_back();
+
+      return std::shared_ptr<platf::img_t>(img, [state = state](platf::img_t *img) {
+        release(*state, img);
+      });
+    }
+
+    /**
+     * Deallocate the free images, the others are deallocated when released.
+     * Images may hold references to the display.
+     */
+    void
+    close() {
+      std::lock_guard lg { state->lock };
+
+      state->closed = true;
+      for (auto img : state->free) {
+        erase_owned(img);
+      }
+      state->free.clear();
+    }
+
+    ~img_pool_t() {
+      close();
+    }
+
+  private:
+    static void
+    release(state_t &state, platf::img_t *img) {
+      std::lock_guard lg { state.lock };
+
+      if (state.closed) {
+        auto it = std::find_if(std::begin(state.owned), std::end(state.owned), [img](auto &owned) {
+          return owned.get() == img;
+        });
+        state.owned.erase(it);
+
+        return;
+      }
+
+      state.free.emplace_back(img);
+      state.released.notify_one();
+    }
+
+    void
+    erase_owned(platf::img_t *img) {
+      auto it = std::find_if(std::begin(state->owned), std::end(state->owned), [img](auto &owned) {
+        return owned.get() == img;
+      });
+      state->owned.erase(it);
+    }
+
+    platf::display_t *disp;
+    std::shared_ptr<state_t> state;
+  };
+
   void
   captureThread(
     std::shared_ptr<safe::queue_t<capture_ctx_t>> capture_ctx_queue,
@@ -791,24 +1329,49 @@ namespace video {
     }
     display_wp = disp;
 
-    std::vector<std::shared_ptr<platf::img_t>> imgs(12);
-    auto round_robin = round_robin_util::make_round_robin<std::shared_ptr<platf::img_t>>(std::begin(imgs), std::end(imgs));
+    // One image being captured, then for each encoder one waiting to be picked up and one being converted
+    auto pool_limit = [&]() {
+      return 2 + 2 * capture_ctxs.size();
+    };
 
-    for (auto &img : imgs) {
-      img = disp->alloc_img();
-      if (!img) {
-        BOOST_LOG(error) << "Couldn't initialize an image"sv;
-        return;
-      }
+    std::optional<img_pool_t> img_pool;
+    img_pool.emplace(disp.get());
+
+    std::unique_ptr<capture_trace::recorder_t> recorder;
+    if (!config::video.capture_trace.empty()) {
+      recorder = capture_trace::make_recorder(config::video.capture_trace, config::video.capture_trace_delta);
     }
 
+    duplicate_filter_t duplicate_filter;
+
     // Capture takes place on this thread
     platf::adjust_thread_priority(platf::thread_priority_e::critical);
+    platf::adjust_thread_affinity(platf::thread_role_e::capture);
 
     while (capture_ctx_queue->running()) {
       bool artificial_reinit = false;
 
+      auto first_img = img_pool->acquire(pool_limit());
+      if (!first_img) {
+        return;
+      }
+
       auto status = disp->capture([&](std::shared_ptr<platf::img_t> &img, bool frame_captured) -> std::shared_ptr<platf::img_t> {
+        if (recorder && frame_captured) {
+          recorder->record(*img);
+        }
+
+        // The encoders keep encoding the previous image at a minimum rate on their own
+        if (frame_captured && duplicate_filter.is_duplicate(*img)) {
+          frame_captured = false;
+        }
+
+        if (frame_captured) {
+          // Never reused, even across capture threads, see convert_cache_t
+          static std::atomic<std::uint64_t> sequence;
+          img->sequence = ++sequence;
+        }
+
         KITTY_WHILE_LOOP(auto capture_ctx = std::begin(capture_ctxs), capture_ctx != std::end(capture_ctxs), {
           if (!capture_ctx->images->running()) {
             capture_ctx = capture_ctxs.erase(capture_ctx);
@@ -828,6 +1391,9 @@ namespace video {
         }
         while (capture_ctx_queue->peek()) {
           capture_ctxs.emplace_back(std::move(*capture_ctx_queue->pop()));
+
+          // The new session only has a dummy image so far
+          duplicate_filter.reset();
         }
 
         if (switch_display_event->peek()) {
@@ -837,15 +1403,9 @@ namespace video {
           return nullptr;
         }
 
-        auto &next_img = *round_robin++;
-        while (next_img.use_count() > 1) {
-          // Sleep a bit to avoid starving the encoder threads
-          std::this_thread::sleep_for(2ms);
-        }
-
-        return next_img;
+        return img_pool->acquire(pool_limit());
       },
-        *round_robin++, &display_cursor);
+        std::move(first_img), &display_cursor);
 
       if (artificial_reinit && status != platf::capture_e::error) {
         status = platf::capture_e::reinit;
@@ -858,9 +1418,7 @@ namespace video {
           reinit_event.raise(true);
 
           // Some classes of images contain references to the display --> display won't delete unless img is deleted
-          for (auto &img : imgs) {
-            img.reset();
-          }
+          img_pool.reset();
 
           // display_wp is modified in this thread only
           // Wait for the other shared_ptr's of display to be destroyed.
@@ -899,14 +1457,9 @@ namespace video {
 
           display_wp = disp;
 
-          // Re-allocate images
-          for (auto &img : imgs) {
-            img = disp->alloc_img();
-            if (!img) {
-              BOOST_LOG(error) << "Couldn't initialize an image"sv;
-              return;
-            }
-          }
+          img_pool.emplace(disp.get());
+
+          duplicate_filter.reset();
 
           reinit_event.reset();
           continue;
@@ -922,25 +1475,270 @@ namespace video {
     }
   }
 
-  int
-  encode(int64_t frame_nr, session_t &session, frame_t::pointer frame, safe::mail_raw_t::queue_t<packet_t> &packets, void *channel_data) {
-    frame->pts = frame_nr;
+  static bool
+  same_config(const config_t &a, const config_t &b) {
+    auto tie = [](const config_t &config) {
+      return std::tie(
+        config.width, config.height, config.framerate, config.bitrate, config.slicesPerFrame,
+        config.numRefFrames, config.encoderCscMode, config.videoFormat, config.dynamicRange);
+    };
 
-    auto &ctx = session.ctx;
+    return tie(a) == tie(b);
+  }
 
-    auto &sps = session.sps;
-    auto &vps = session.vps;
+  /**
+   * Sessions with identical configurations can share a single encoder, see config::video.shared_encoding.
+   * The thread of one of the sessions, the leader, runs the encoder and each packet is sent to every session.
+   * When the leader leaves, another session takes over with a new encoder.
+   *
+   * Frame numbers are rebased, so each session sees a stream starting at frame 1 with an IDR frame.
+   * The packets since the latest IDR frame are kept, so a session joining later can start right away,
+   * without forcing an IDR frame on the others.
+   */
+  class broadcast_t {
+  public:
+    // Past that, a session joining later gets a new IDR frame instead
+    static constexpr std::size_t max_gop_size = 16 * 1024 * 1024;
 
-    /* send the frame to the encoder */
-    auto ret = avcodec_send_frame(ctx.get(), frame);
-    if (ret < 0) {
-      char err_str[AV_ERROR_MAX_STRING_SIZE] { 0 };
-      BOOST_LOG(error) << "Could not send a frame for encoding: "sv << av_make_error_string(err_str, AV_ERROR_MAX_STRING_SIZE, ret);
+    /**
+     * Join the group of sessions sharing config, creating it if needed.
+     * return true in synced if the session received the packets since the latest IDR frame
+     */
+    static std::shared_ptr<broadcast_t>
+    join(const config_t &config, void *channel_data, safe::mail_raw_t::queue_t<packet_t> &packets, bool &synced) {
+      static std::mutex registry_lock;
+      static std::vector<std::weak_ptr<broadcast_t>> registry;
+
+      std::shared_ptr<broadcast_t> broadcast;
+      {
+        std::lock_guard lg { registry_lock };
 
-      return -1;
-    }
+        registry.erase(std::remove_if(std::begin(registry), std::end(registry), [](auto &broadcast) {
+          return broadcast.expired();
+        }),
+          std::end(registry));
 
-    while (ret >= 0) {
+        for (auto &weak : registry) {
+          auto existing = weak.lock();
+          if (existing && same_config(existing->config, config)) {
+            broadcast = std::move(existing);
+            break;
+          }
+        }
+
+        if (!broadcast) {
+          broadcast = std::make_shared<broadcast_t>(config);
+          registry.emplace_back(broadcast);
+        }
+      }
+
+      std::lock_guard lg { broadcast->lock };
+
+      auto &subscriber = broadcast->subscribers.emplace_back(subscriber_t { channel_data });
+
+      synced = broadcast->gop_valid && !broadcast->gop.empty();
+      if (synced) {
+        subscriber.synced = true;
+        subscriber.frame_offset = broadcast->gop.front()->av_packet->pts - 1;
+
+        for (auto &packet : broadcast->gop) {
+          packets->raise(copy(*packet, subscriber));
+        }
+      }
+      else {
+        broadcast->idr_requested = true;
+      }
+
+      BOOST_LOG(info) << "Sharing an encoder between "sv << broadcast->subscribers.size() << " sessions"sv;
+
+      return broadcast;
+    }
+
+    explicit broadcast_t(const config_t &config):
+        config { config } {}
+
+    void
+    leave(void *channel_data) {
+      std::lock_guard lg { lock };
+
+      subscribers.erase(std::remove_if(std::begin(subscribers), std::end(subscribers), [channel_data](auto &subscriber) {
+        return subscriber.channel_data == channel_data;
+      }),
+        std::end(subscribers));
+
+      if (leader == channel_data) {
+        leader = nullptr;
+      }
+    }
+
+    /**
+     * return true if the session is, or has just become, the one running the encoder
+     */
+    bool
+    lead(void *channel_data) {
+      std::lock_guard lg { lock };
+
+      if (!leader) {
+        leader = channel_data;
+      }
+
+      return leader == channel_data;
+    }
+
+    void
+    request_idr() {
+      idr_requested = true;
+    }
+
+    /**
+     * return true once for each request made since the previous call
+     */
+    bool
+    pop_idr_request() {
+      return idr_requested.exchange(false);
+    }
+
+    /**
+     * Send a packet of the shared encoder to every session
+     */
+    void
+    send(packet_t packet, safe::mail_raw_t::queue_t<packet_t> &packets) {
+      std::lock_guard lg { lock };
+
+      auto av_packet = packet->av_packet;
+      bool key_frame = av_packet->flags & AV_PKT_FLAG_KEY;
+
+      for (auto &subscriber : subscribers) {
+        if (!subscriber.synced) {
+          if (!key_frame) {
+            continue;
+          }
+
+          subscriber.synced = true;
+          subscriber.frame_offset = av_packet->pts - 1;
+        }
+
+        packets->raise(copy(*packet, subscriber));
+      }
+
+      if (key_frame) {
+        gop.clear();
+        gop_size = 0;
+        gop_valid = true;
+      }
+
+      if (gop_valid) {
+        gop_size += av_packet->size;
+        gop.emplace_back(std::move(packet));
+
+        if (gop_size > max_gop_size) {
+          gop.clear();
+          gop_valid = false;
+        }
+      }
+    }
+
+    // Shared by the successive leaders, so frame numbers keep increasing
+    int frame_nr = 1;
+
+  private:
+    struct subscriber_t {
+      void *channel_data;
+
+      // Until the first IDR frame, nothing is sent
+      bool synced {};
+      std::int64_t frame_offset {};
+    };
+
+    static packet_t
+    copy(packet_raw_t &packet, const subscriber_t &subscriber) {
+      auto copy = std::make_unique<packet_t::element_type>(nullptr);
+
+      av_packet_ref(copy->av_packet, packet.av_packet);
+      copy->av_packet->pts -= subscriber.frame_offset;
+      copy->replacements = packet.replacements;
+      copy->channel_data = subscriber.channel_data;
+
+      return copy;
+    }
+
+    config_t config;
+
+    std::mutex lock;
+    std::vector<subscriber_t> subscribers;
+    void *leader {};
+
+    std::atomic<bool> idr_requested {};
+
+    std::vector<packet_t> gop;
+    std::size_t gop_size {};
+    bool gop_valid {};
+  };
+
+  /**
+   * Ask the encoder to spend more bits on the regions of the image known to have changed.
+   * Encoders without support for regions of interest ignore the side data.
+   */
+  static void
+  set_regions_of_interest(AVFrame *frame, const platf::img_t &img) {
+    av_frame_remove_side_data(frame, AV_FRAME_DATA_REGIONS_OF_INTEREST);
+
+    // With only the cursor known, the rest of the changes would lose their bits to it
+    if (!img.damage_complete || img.damage.empty() || img.width <= 0 || img.height <= 0) {
+      return;
+    }
+
+    // Nothing stands out when the whole image changed
+    for (auto &rect : img.damage) {
+      if (rect.x <= 0 && rect.y <= 0 && rect.x + rect.width >= img.width && rect.y + rect.height >= img.height) {
+        return;
+      }
+    }
+
+    auto side_data = av_frame_new_side_data(frame, AV_FRAME_DATA_REGIONS_OF_INTEREST, sizeof(AVRegionOfInterest) * img.damage.size());
+    if (!side_data) {
+      return;
+    }
+
+    // The image is scaled to fit the frame, keeping its aspect ratio, and centered
+    auto scalar = std::fminf((float) frame->width / img.width, (float) frame->height / img.height);
+    auto offsetX = (frame->width - img.width * scalar) / 2;
+    auto offsetY = (frame->height - img.height * scalar) / 2;
+
+    auto roi = (AVRegionOfInterest *) side_data->data;
+    for (auto &rect : img.damage) {
+      roi->self_size = sizeof(AVRegionOfInterest);
+      roi->left = (int) std::floor(offsetX + rect.x * scalar);
+      roi->top = (int) std::floor(offsetY + rect.y * scalar);
+      roi->right = (int) std::ceil(offsetX + (rect.x + rect.width) * scalar);
+      roi->bottom = (int) std::ceil(offsetY + (rect.y + rect.height) * scalar);
+
+      // Negative is better quality, -1/5 is about 5 QP lower with libx264
+      roi->qoffset = AVRational { -1, 5 };
+
+      ++roi;
+    }
+  }
+
+  int
+  encode(int64_t frame_nr, session_t &session, frame_t::pointer frame, safe::mail_raw_t::queue_t<packet_t> &packets, void *channel_data, broadcast_t *broadcast = nullptr) {
+    frame->pts = frame_nr;
+
+    auto &ctx = session.ctx;
+
+    auto &sps = session.sps;
+    auto &vps = session.vps;
+
+    /* send the frame to the encoder */
+    auto ret = avcodec_send_frame(ctx.get(), frame);
+    if (ret < 0) {
+      char err_str[AV_ERROR_MAX_STRING_SIZE] { 0 };
+      BOOST_LOG(error) << "Could not send a frame for encoding: "sv << av_make_error_string(err_str, AV_ERROR_MAX_STRING_SIZE, ret);
+
+      return -1;
+    }
+
+    while (ret >= 0) {
       auto packet = std::make_unique<packet_t::element_type>(nullptr);
       auto av_packet = packet.get()->av_packet;
 
@@ -953,6 +1751,8 @@ namespace video {
       }
 
       if (session.inject) {
+        auto replacements = std::make_shared<std::vector<packet_raw_t::replace_t>>(*session.replacements);
+
         if (session.inject == 1) {
           auto h264 = cbs::make_sps_h264(ctx.get(), av_packet);
 
@@ -964,21 +1764,29 @@ namespace video {
           sps = std::move(hevc.sps);
           vps = std::move(hevc.vps);
 
-          session.replacements.emplace_back(
+          replacements->emplace_back(
             std::string_view((char *) std::begin(vps.old), vps.old.size()),
             std::string_view((char *) std::begin(vps._new), vps._new.size()));
         }
 
         session.inject = 0;
 
-        session.replacements.emplace_back(
+        replacements->emplace_back(
           std::string_view((char *) std::begin(sps.old), sps.old.size()),
           std::string_view((char *) std::begin(sps._new), sps._new.size()));
+
+        session.replacements = std::move(replacements);
       }
 
-      packet->replacements = &session.replacements;
+      packet->replacements = session.replacements;
       packet->channel_data = channel_data;
-      packets->raise(std::move(packet));
+
+      if (broadcast) {
+        broadcast->send(std::move(packet), packets);
+      }
+      else {
+        packets->raise(std::move(packet));
+      }
     }
 
     return 0;
@@ -1289,12 +2097,296 @@ namespace video {
     if (!video_format[encoder_t::NALU_PREFIX_5b]) {
       auto nalu_prefix = config.videoFormat ? hevc_nalu : h264_nalu;
 
-      session.replacements.emplace_back(nalu_prefix.substr(1), nalu_prefix);
+      auto replacements = std::make_shared<std::vector<packet_raw_t::replace_t>>();
+      replacements->emplace_back(nalu_prefix.substr(1), nalu_prefix);
+
+      session.replacements = std::move(replacements);
     }
 
     return std::make_optional(std::move(session));
   }
 
+  /**
+   * Recently closed encoder sessions are kept open for a while,
+   * so a session with the same settings can start without opening the encoder again, e.g. when a client reconnects or after a reinit.
+   *
+   * Only sessions that convert the images in system memory are kept, the others depend on the display that created them.
+   * HDR sessions carry the metadata of their display, so they aren't kept either.
+   */
+  class session_pool_t {
+  public:
+    static constexpr std::size_t MAX_SESSIONS = 2;
+    static constexpr auto IDLE_TIMEOUT = 60s;
+
+    /**
+     * width, height <-- The dimensions of the captured images
+     */
+    std::optional<session_t>
+    take(const encoder_t &encoder, const config_t &config, int width, int height) {
+      std::lock_guard lg { mutex };
+
+      auto it = std::find_if(std::begin(sessions), std::end(sessions), [&](const entry_t &entry) {
+        return entry.encoder == encoder.name && entry.width == width && entry.height == height && same_config(entry.config, config);
+      });
+
+      if (it == std::end(sessions)) {
+        return std::nullopt;
+      }
+
+      auto session = std::move(it->session);
+      sessions.erase(it);
+
+      // The encoder was flushed, start over with an IDR frame
+      auto frame = session.device->frame;
+      frame->pict_type = AV_PICTURE_TYPE_I;
+      frame->key_frame = 1;
+
+      BOOST_LOG(debug) << "Reusing idle encoder session"sv;
+      return std::make_optional(std::move(session));
+    }
+
+    void
+    put(const encoder_t &encoder, const config_t &config, int width, int height, session_t &&session) {
+      if (config.dynamicRange || !dynamic_cast<swdevice_t *>(session.device.get()) || flush(session)) {
+        return;
+      }
+
+      auto idle_since = std::chrono::steady_clock::now();
+
+      {
+        std::lock_guard lg { mutex };
+
+        sessions.emplace(std::begin(sessions), entry_t { encoder.name, config, width, height, idle_since, std::move(session) });
+        if (sessions.size() > MAX_SESSIONS) {
+          sessions.pop_back();
+        }
+      }
+
+      task_pool.pushDelayed([this]() { expire(); }, IDLE_TIMEOUT);
+    }
+
+  private:
+    struct entry_t {
+      std::string_view encoder;
+      config_t config;
+      int width;
+      int height;
+
+      std::chrono::steady_clock::time_point idle_since;
+      session_t session;
+    };
+
+    /**
+     * Drain the encoder and reset it, so the next session doesn't get the packets of the previous one
+     */
+    static int
+    flush(session_t &session) {
+      auto &ctx = session.ctx;
+      if (!(ctx->codec->capabilities & AV_CODEC_CAP_ENCODER_FLUSH)) {
+        return -1;
+      }
+
+      if (avcodec_send_frame(ctx.get(), nullptr) < 0) {
+        return -1;
+      }
+
+      auto packet = std::make_unique<packet_t::element_type>(nullptr);
+      int ret;
+      do {
+        ret = avcodec_receive_packet(ctx.get(), packet->av_packet);
+        av_packet_unref(packet->av_packet);
+      } while (ret >= 0);
+
+      if (ret != AVERROR_EOF) {
+        return -1;
+      }
+
+      avcodec_flush_buffers(ctx.get());
+
+      return 0;
+    }
+
+    void
+    expire() {
+      auto now = std::chrono::steady_clock::now();
+
+      std::lock_guard lg { mutex };
+      sessions.erase(std::remove_if(std::begin(sessions), std::end(sessions), [&](const entry_t &entry) {
+        return now - entry.idle_since >= IDLE_TIMEOUT;
+      }),
+        std::end(sessions));
+    }
+
+    std::mutex mutex;
+
+    // The most recently closed session first
+    std::vector<entry_t> sessions;
+  };
+
+  static session_pool_t &
+  session_pool() {
+    static session_pool_t pool;
+
+    return pool;
+  }
+
+  /**
+   * make_session(), unless a matching session is kept in the session pool
+   */
+  std::optional<session_t>
+  open_session(platf::display_t *disp, const encoder_t &encoder, const config_t &config, int width, int height, std::shared_ptr<platf::hwdevice_t> &&hwdevice) {
+    if (!hwdevice->data) {
+      if (auto session = session_pool().take(encoder, config, width, height)) {
+        return session;
+      }
+    }
+
+    return make_session(disp, encoder, config, width, height, std::move(hwdevice));
+  }
+
+  /**
+   * Lowers the resolution of the encoded frames when converting and encoding them takes longer than the frame interval,
+   * and raises it again once the encoder has room to spare. The client keeps its viewport, its decoder scales the frames.
+   * See config::video.dynamic_resolution
+   */
+  class resolution_governor_t {
+  public:
+    // In percent of the requested resolution
+    static constexpr std::array<int, 3> SCALES { 100, 85, 75 };
+
+    // The frame times are averaged over a window
+    static constexpr auto WINDOW = 2s;
+
+    // Minimum time between changes, raising the resolution again has to wait longer to avoid oscillating
+    static constexpr auto DOWN_INTERVAL = 4s;
+    static constexpr auto UP_INTERVAL = 10s;
+
+    explicit resolution_governor_t(int framerate):
+        budget { std::chrono::nanoseconds { 1s } / framerate } {
+      auto now = std::chrono::steady_clock::now();
+
+      window_start = now;
+      last_change = now;
+      level_since = now;
+    }
+
+    /**
+     * frame_time <-- The time it took to convert and encode a frame
+     * return the level the resolution should change to, see SCALES
+     */
+    std::optional<std::size_t>
+    record(std::chrono::steady_clock::duration frame_time) {
+      auto now = std::chrono::steady_clock::now();
+
+      window_time += frame_time;
+      ++window_frames;
+
+      if (now - window_start < WINDOW) {
+        return std::nullopt;
+      }
+
+      auto average = window_time / window_frames;
+
+      window_start = now;
+      window_time = {};
+      window_frames = 0;
+
+      // The budget is blown
+      if (average > budget && level + 1 < SCALES.size() && now - last_change >= DOWN_INTERVAL) {
+        return level + 1;
+      }
+
+      // Converting and encoding scale with the number of pixels, there must be room left at the next level
+      if (level > 0 && now - last_change >= UP_INTERVAL) {
+        auto ratio = (double) (SCALES[level - 1] * SCALES[level - 1]) / (SCALES[level] * SCALES[level]);
+        if (average * ratio < budget * 3 / 4) {
+          return level - 1;
+        }
+      }
+
+      return std::nullopt;
+    }
+
+    /**
+     * The session now encodes at SCALES[level]
+     */
+    void
+    set_level(std::size_t new_level) {
+      auto now = std::chrono::steady_clock::now();
+
+      time_at_level[level] += now - level_since;
+      if (new_level > level) {
+        ++downscales;
+      }
+      else {
+        ++upscales;
+      }
+
+      level = new_level;
+      level_since = now;
+      last_change = now;
+    }
+
+    /**
+     * The resolution couldn't be changed, wait before trying again
+     */
+    void
+    postpone() {
+      last_change = std::chrono::steady_clock::now();
+    }
+
+    int
+    scale() const {
+      return SCALES[level];
+    }
+
+    void
+    log_stats() const {
+      if (!downscales) {
+        return;
+      }
+
+      auto time = time_at_level;
+      time[level] += std::chrono::steady_clock::now() - level_since;
+
+      BOOST_LOG(info) << "Dynamic resolution: lowered "sv << downscales << " times, raised "sv << upscales << " times"sv;
+      for (std::size_t x = 0; x < SCALES.size(); ++x) {
+        BOOST_LOG(info) << "Dynamic resolution: "sv << SCALES[x] << "% for "sv
+                        << std::chrono::duration_cast<std::chrono::seconds>(time[x]).count() << 's';
+      }
+    }
+
+  private:
+    std::chrono::steady_clock::duration budget;
+
+    std::size_t level = 0;
+    std::chrono::steady_clock::time_point last_change;
+
+    std::chrono::steady_clock::time_point window_start;
+    std::chrono::steady_clock::duration window_time {};
+    int window_frames = 0;
+
+    // Statistics
+    int downscales = 0;
+    int upscales = 0;
+    std::array<std::chrono::steady_clock::duration, SCALES.size()> time_at_level {};
+    std::chrono::steady_clock::time_point level_since;
+  };
+
+  /**
+   * config scaled down to scale percent of its resolution
+   */
+  static config_t
+  scale_config(const config_t &config, int scale) {
+    auto scaled = config;
+
+    // Keep the dimensions a multiple of 8, as some encoders require
+    scaled.width = (config.width * scale / 100) & ~7;
+    scaled.height = (config.height * scale / 100) & ~7;
+
+    return scaled;
+  }
+
   void
   encode_run(
     int &frame_nr,  // Store progress of the frame number
@@ -1305,8 +2397,9 @@ namespace video {
     std::shared_ptr<platf::hwdevice_t> &&hwdevice,
     safe::signal_t &reinit_event,
     const encoder_t &encoder,
-    void *channel_data) {
-    auto session = make_session(disp.get(), encoder, config, disp->width, disp->height, std::move(hwdevice));
+    void *channel_data,
+    broadcast_t *broadcast) {
+    auto session = open_session(disp.get(), encoder, config, disp->width, disp->height, std::move(hwdevice));
     if (!session) {
       return;
     }
@@ -1324,39 +2417,101 @@ namespace video {
       return;
     }
 
+    // The configuration of the current session, its resolution may be scaled down
+    auto session_config = config;
+
+    std::optional<resolution_governor_t> governor;
+    if (config::video.dynamic_resolution) {
+      governor.emplace(config.framerate);
+    }
+
+    // A new session starts from the last image
+    std::shared_ptr<platf::img_t> last_img = dummy_img;
+
     while (true) {
       if (shutdown_event->peek() || reinit_event.peek() || !images->running()) {
         break;
       }
 
+      // With a shared encoder, the other sessions may request an IDR frame as well
+      bool idr = broadcast && broadcast->pop_idr_request();
       if (idr_events->peek()) {
+        idr_events->pop();
+        idr = true;
+      }
+
+      if (idr) {
         frame->pict_type = AV_PICTURE_TYPE_I;
         frame->key_frame = 1;
-
-        idr_events->pop();
       }
 
+      std::chrono::steady_clock::duration frame_time {};
+
       // Encode at a minimum of 10 FPS to avoid image quality issues with static content
       if (!frame->key_frame || images->peek()) {
         if (auto img = images->pop(100ms)) {
+          auto convert_start = std::chrono::steady_clock::now();
           if (session->device->convert(*img)) {
             BOOST_LOG(error) << "Could not convert image"sv;
             return;
           }
+          frame_time += std::chrono::steady_clock::now() - convert_start;
+
+          set_regions_of_interest(frame, *img);
+          last_img = std::move(img);
         }
         else if (!images->running()) {
           break;
         }
+        else {
+          // Nothing changed since the previous frame
+          av_frame_remove_side_data(frame, AV_FRAME_DATA_REGIONS_OF_INTEREST);
+        }
       }
 
-      if (encode(frame_nr++, *session, frame, packets, channel_data)) {
+      auto encode_start = std::chrono::steady_clock::now();
+      if (encode(frame_nr++, *session, frame, packets, channel_data, broadcast)) {
         BOOST_LOG(error) << "Could not encode video packet"sv;
         return;
       }
+      frame_time += std::chrono::steady_clock::now() - encode_start;
 
       frame->pict_type = AV_PICTURE_TYPE_NONE;
       frame->key_frame = 0;
+
+      auto level = governor ? governor->record(frame_time) : std::nullopt;
+      if (level) {
+        auto scaled_config = scale_config(config, resolution_governor_t::SCALES[*level]);
+
+        BOOST_LOG(info) << "Encoding at "sv << resolution_governor_t::SCALES[*level] << "% of the resolution: "sv
+                        << scaled_config.width << 'x' << scaled_config.height;
+
+        // The new session starts with an IDR frame
+        auto pix_fmt = config.dynamicRange == 0 ? map_pix_fmt(encoder.static_pix_fmt) : map_pix_fmt(encoder.dynamic_pix_fmt);
+        auto hwdevice = disp->make_hwdevice(pix_fmt);
+        auto scaled_session = hwdevice ? open_session(disp.get(), encoder, scaled_config, disp->width, disp->height, std::move(hwdevice)) : std::nullopt;
+        if (!scaled_session || scaled_session->device->convert(*last_img)) {
+          BOOST_LOG(warning) << "Couldn't change the resolution, keeping "sv << governor->scale() << '%';
+          governor->postpone();
+
+          continue;
+        }
+
+        // Kept for stepping back, packets still in the queue share its replacements
+        session_pool().put(encoder, session_config, disp->width, disp->height, std::move(*session));
+        session = std::move(scaled_session);
+        session_config = scaled_config;
+        frame = session->device->frame;
+
+        governor->set_level(*level);
+      }
     }
+
+    if (governor) {
+      governor->log_stats();
+    }
+
+    session_pool().put(encoder, session_config, disp->width, disp->height, std::move(*session));
   }
 
   input::touch_port_t
@@ -1411,7 +2566,7 @@ namespace video {
     }
     ctx.hdr_events->raise(std::move(hdr_info));
 
-    auto session = make_session(disp, encoder, ctx.config, img.width, img.height, std::move(hwdevice));
+    auto session = open_session(disp, encoder, ctx.config, img.width, img.height, std::move(hwdevice));
     if (!session) {
       return std::nullopt;
     }
@@ -1481,6 +2636,8 @@ namespace video {
       synced_sessions.emplace_back(std::move(*synced_session));
     }
 
+    duplicate_filter_t duplicate_filter;
+
     auto ec = platf::capture_e::ok;
     while (encode_session_ctx_queue.running()) {
       auto snapshot_cb = [&](std::shared_ptr<platf::img_t> &img, bool frame_captured) -> std::shared_ptr<platf::img_t> {
@@ -1499,8 +2656,14 @@ namespace video {
           }
 
           synced_sessions.emplace_back(std::move(*encode_session));
+
+          // The new session only has a dummy image so far
+          duplicate_filter.reset();
         }
 
+        bool duplicate = frame_captured && duplicate_filter.is_duplicate(*img);
+        auto now = std::chrono::steady_clock::now();
+
         KITTY_WHILE_LOOP(auto pos = std::begin(synced_sessions), pos != std::end(synced_sessions), {
           auto frame = pos->session.device->frame;
           auto ctx = pos->ctx;
@@ -1508,6 +2671,7 @@ namespace video {
             // Let waiting thread know it can delete shutdown_event
             ctx->join_event->raise(true);
 
+            session_pool().put(encoder, ctx->config, img->width, img->height, std::move(pos->session));
             pos = synced_sessions.erase(pos);
             synced_session_ctxs.erase(std::find_if(std::begin(synced_session_ctxs), std::end(synced_session_ctxs), [&ctx_p = ctx](auto &ctx) {
               return ctx.get() == ctx_p;
@@ -1527,19 +2691,34 @@ namespace video {
             ctx->idr_events->pop();
           }
 
-          if (frame_captured && pos->session.device->convert(*img)) {
-            BOOST_LOG(error) << "Could not convert image"sv;
-            ctx->shutdown_event->raise(true);
+          // An identical image is only encoded again at the minimum of 10 FPS
+          if (duplicate && !frame->key_frame && now - pos->last_encode < 100ms) {
+            ++pos;
 
             continue;
           }
 
+          if (frame_captured && !duplicate) {
+            if (pos->session.device->convert(*img)) {
+              BOOST_LOG(error) << "Could not convert image"sv;
+              ctx->shutdown_event->raise(true);
+
+              continue;
+            }
+
+            set_regions_of_interest(frame, *img);
+          }
+          else {
+            av_frame_remove_side_data(frame, AV_FRAME_DATA_REGIONS_OF_INTEREST);
+          }
+
           if (encode(ctx->frame_nr++, pos->session, frame, ctx->packets, ctx->channel_data)) {
             BOOST_LOG(error) << "Could not encode video packet"sv;
             ctx->shutdown_event->raise(true);
 
             continue;
           }
+          pos->last_encode = now;
 
           frame->pict_type = AV_PICTURE_TYPE_NONE;
           frame->key_frame = 0;
@@ -1563,7 +2742,15 @@ namespace video {
         case platf::capture_e::error:
         case platf::capture_e::ok:
         case platf::capture_e::timeout:
-          return ec != platf::capture_e::ok ? ec : status;
+          status = ec != platf::capture_e::ok ? ec : status;
+          if (status == platf::capture_e::reinit) {
+            // The sessions are opened again once the display is back
+            for (auto &synced_session : synced_sessions) {
+              session_pool().put(encoder, synced_session.ctx->config, img->width, img->height, std::move(synced_session.session));
+            }
+          }
+
+          return status;
       }
     }
 
@@ -1593,6 +2780,7 @@ namespace video {
 
     // Encoding and capture takes place on this thread
     platf::adjust_thread_priority(platf::thread_priority_e::high);
+    platf::adjust_thread_affinity(platf::thread_role_e::capture);
 
     while (encode_run_sync(synced_session_ctxs, ctx) == encode_e::reinit) {}
   }
@@ -1615,19 +2803,50 @@ namespace video {
       return;
     }
 
-    ref->capture_ctx_queue->raise(capture_ctx_t { images, config });
-
-    if (!ref->capture_ctx_queue->running()) {
-      return;
-    }
-
     int frame_nr = 1;
 
+    auto idr_events = mail->event<bool>(mail::idr);
     auto touch_port_event = mail->event<input::touch_port_t>(mail::touch_port);
     auto hdr_event = mail->event<hdr_info_t>(mail::hdr);
 
+    std::shared_ptr<broadcast_t> broadcast;
+    if (config::video.shared_encoding) {
+      auto packets = mail::man->queue<packet_t>(mail::video_packets);
+
+      bool synced;
+      broadcast = broadcast_t::join(config, channel_data, packets, synced);
+
+      // The packets since the latest IDR frame already allow the client to start decoding
+      if (synced && idr_events->peek()) {
+        idr_events->pop();
+      }
+    }
+
+    auto leave_broadcast = util::fail_guard([&]() {
+      if (broadcast) {
+        broadcast->leave(channel_data);
+      }
+    });
+
+    auto announce_display = [&](platf::display_t *display) {
+      // absolute mouse coordinates require that the dimensions of the screen are known
+      touch_port_event->raise(make_port(display, config));
+
+      // Update client with our current HDR display state
+      hdr_info_t hdr_info = std::make_unique<hdr_info_raw_t>(false);
+      if (config.dynamicRange && display->is_hdr()) {
+        display->get_hdr_metadata(hdr_info->metadata);
+        hdr_info->enabled = true;
+      }
+      hdr_event->raise(std::move(hdr_info));
+    };
+
+    // Only a session running an encoder needs the captured images
+    bool capturing = false;
+
     // Encoding takes place on this thread
     platf::adjust_thread_priority(platf::thread_priority_e::high);
+    platf::adjust_thread_affinity(platf::thread_role_e::encode);
 
     while (!shutdown_event->peek() && images->running()) {
       // Wait for the main capture event when the display is being reinitialized
@@ -1635,6 +2854,42 @@ namespace video {
         std::this_thread::sleep_for(20ms);
         continue;
       }
+
+      if (broadcast && !broadcast->lead(channel_data)) {
+        // Another session runs the encoder, pass the IDR requests on until this one has to take over
+        bool announced = false;
+        while (!shutdown_event->peek() && !ref->reinit_event.peek() && !broadcast->lead(channel_data)) {
+          if (!announced) {
+            std::shared_ptr<platf::display_t> display;
+            {
+              auto lg = ref->display_wp.lock();
+              display = ref->display_wp->lock();
+            }
+
+            if (display) {
+              announce_display(display.get());
+              announced = true;
+            }
+          }
+
+          if (idr_events->pop(10ms)) {
+            broadcast->request_idr();
+          }
+        }
+
+        continue;
+      }
+
+      if (!capturing) {
+        ref->capture_ctx_queue->raise(capture_ctx_t { images, config });
+
+        if (!ref->capture_ctx_queue->running()) {
+          return;
+        }
+
+        capturing = true;
+      }
+
       // Wait for the display to be ready
       std::shared_ptr<platf::display_t> display;
       {
@@ -1653,24 +2908,15 @@ namespace video {
         return;
       }
 
-      // absolute mouse coordinates require that the dimensions of the screen are known
-      touch_port_event->raise(make_port(display.get(), config));
-
-      // Update client with our current HDR display state
-      hdr_info_t hdr_info = std::make_unique<hdr_info_raw_t>(false);
-      if (config.dynamicRange && display->is_hdr()) {
-        display->get_hdr_metadata(hdr_info->metadata);
-        hdr_info->enabled = true;
-      }
-      hdr_event->raise(std::move(hdr_info));
+      announce_display(display.get());
 
       encode_run(
-        frame_nr,
+        broadcast ? broadcast->frame_nr : frame_nr,
         mail, images,
         config, display,
         std::move(hwdevice),
         ref->reinit_event, *ref->encoder_p,
-        channel_data);
+        channel_data, broadcast.get());
     }
   }
 
@@ -1710,29 +2956,62 @@ namespace video {
     NALU_PREFIX_5b = 0x02,
   };
 
-  int
-  validate_config(std::shared_ptr<platf::display_t> &disp, const encoder_t &encoder, const config_t &config) {
-    reset_display(disp, encoder.base_dev_type, config::video.output_name, config);
-    if (!disp) {
+  /**
+   * The display and dummy image shared by the probes of an encoder, as creating them is slow.
+   * The display is only recreated when a probe needs another dynamic range.
+   */
+  struct probe_display_t {
+    std::shared_ptr<platf::display_t> disp;
+    std::shared_ptr<platf::img_t> img;
+    std::optional<int> dynamic_range;
+
+    // Parallel probes share the display
+    std::mutex mutex;
+  };
+
+  static int
+  reset_probe_display(probe_display_t &probe, const encoder_t &encoder, const config_t &config) {
+    if (probe.disp && probe.dynamic_range == config.dynamicRange) {
+      return 0;
+    }
+
+    probe.img.reset();
+    reset_display(probe.disp, encoder.base_dev_type, config::video.output_name, config);
+    if (!probe.disp) {
+      return -1;
+    }
+
+    auto img = probe.disp->alloc_img();
+    if (!img || probe.disp->dummy_img(img.get())) {
+      probe.disp.reset();
       return -1;
     }
 
+    probe.img = std::move(img);
+    probe.dynamic_range = config.dynamicRange;
+
+    return 0;
+  }
+
+  int
+  validate_config(probe_display_t &probe, const encoder_t &encoder, const config_t &config) {
     auto pix_fmt = config.dynamicRange == 0 ? map_pix_fmt(encoder.static_pix_fmt) : map_pix_fmt(encoder.dynamic_pix_fmt);
-    auto hwdevice = disp->make_hwdevice(pix_fmt);
+
+    std::shared_ptr<platf::hwdevice_t> hwdevice;
+    {
+      std::lock_guard lg { probe.mutex };
+      hwdevice = probe.disp->make_hwdevice(pix_fmt);
+    }
     if (!hwdevice) {
       return -1;
     }
 
-    auto session = make_session(disp.get(), encoder, config, disp->width, disp->height, std::move(hwdevice));
+    auto session = make_session(probe.disp.get(), encoder, config, probe.disp->width, probe.disp->height, std::move(hwdevice));
     if (!session) {
       return -1;
     }
 
-    auto img = disp->alloc_img();
-    if (!img || disp->dummy_img(img.get())) {
-      return -1;
-    }
-    if (session->device->convert(*img)) {
+    if (session->device->convert(*probe.img)) {
       return -1;
     }
 
@@ -1740,7 +3019,9 @@ namespace video {
 
     frame->pict_type = AV_PICTURE_TYPE_I;
 
-    auto packets = mail::man->queue<packet_t>(mail::video_packets);
+    // Parallel probes mustn't take each other's packets
+    auto probe_mail = std::make_shared<safe::mail_raw_t>();
+    auto packets = probe_mail->queue<packet_t>(mail::video_packets);
     while (!packets->peek()) {
       if (encode(1, *session, frame, packets, nullptr)) {
         return -1;
@@ -1769,9 +3050,42 @@ namespace video {
     return flag;
   }
 
+  /**
+   * Run validate_config() for each of configs, all at once if the encoder allows it.
+   * The configs must have the same dynamic range, so they can share the display.
+   */
+  static std::vector<int>
+  validate_configs(probe_display_t &probe, const encoder_t &encoder, const std::vector<config_t> &configs) {
+    std::vector<int> results(configs.size(), -1);
+    if (configs.empty() || reset_probe_display(probe, encoder, configs.front())) {
+      return results;
+    }
+
+    if (!(encoder.flags & PARALLEL_ENCODING)) {
+      for (std::size_t x = 0; x < configs.size(); ++x) {
+        results[x] = validate_config(probe, encoder, configs[x]);
+      }
+
+      return results;
+    }
+
+    std::vector<std::future<int>> probes;
+    for (auto &config : configs) {
+      probes.emplace_back(std::async(std::launch::async, [&probe, &encoder, &config]() {
+        return validate_config(probe, encoder, config);
+      }));
+    }
+
+    for (std::size_t x = 0; x < configs.size(); ++x) {
+      results[x] = probes[x].get();
+    }
+
+    return results;
+  }
+
   bool
   validate_encoder(encoder_t &encoder) {
-    std::shared_ptr<platf::display_t> disp;
+    probe_display_t probe;
 
     BOOST_LOG(info) << "Trying encoder ["sv << encoder.name << ']';
     auto fg = util::fail_guard([&]() {
@@ -1791,8 +3105,9 @@ namespace video {
     config_t config_autoselect { 1920, 1080, 60, 1000, 1, 0, 1, 0, 0 };
 
   retry:
-    auto max_ref_frames_h264 = validate_config(disp, encoder, config_max_ref_frames);
-    auto autoselect_h264 = validate_config(disp, encoder, config_autoselect);
+    auto results_h264 = validate_configs(probe, encoder, { config_max_ref_frames, config_autoselect });
+    auto max_ref_frames_h264 = results_h264[0];
+    auto autoselect_h264 = results_h264[1];
 
     if (max_ref_frames_h264 < 0 && autoselect_h264 < 0) {
       if (encoder.h264.qp && encoder.h264[encoder_t::CBR]) {
@@ -1817,14 +3132,16 @@ namespace video {
     encoder.h264[encoder_t::REF_FRAMES_AUTOSELECT] = autoselect_h264 >= 0;
     encoder.h264[encoder_t::PASSED] = true;
 
-    encoder.h264[encoder_t::SLICE] = validate_config(disp, encoder, config_max_ref_frames);
+    // Same config as above, there's no need to encode it again
+    encoder.h264[encoder_t::SLICE] = max_ref_frames_h264;
     if (test_hevc) {
       config_max_ref_frames.videoFormat = 1;
       config_autoselect.videoFormat = 1;
 
     retry_hevc:
-      auto max_ref_frames_hevc = validate_config(disp, encoder, config_max_ref_frames);
-      auto autoselect_hevc = validate_config(disp, encoder, config_autoselect);
+      auto results_hevc = validate_configs(probe, encoder, { config_max_ref_frames, config_autoselect });
+      auto max_ref_frames_hevc = results_hevc[0];
+      auto autoselect_hevc = results_hevc[1];
 
       // If HEVC must be supported, but it is not supported
       if (max_ref_frames_hevc < 0 && autoselect_hevc < 0) {
@@ -1866,9 +3183,16 @@ namespace video {
       h264.videoFormat = 0;
       hevc.videoFormat = 1;
 
-      encoder.h264[flag] = validate_config(disp, encoder, h264) >= 0;
+      std::vector<config_t> flag_configs { h264 };
+      if (encoder.hevc[encoder_t::PASSED]) {
+        flag_configs.emplace_back(hevc);
+      }
+
+      auto results = validate_configs(probe, encoder, flag_configs);
+
+      encoder.h264[flag] = results[0] >= 0;
       if (encoder.hevc[encoder_t::PASSED]) {
-        encoder.hevc[flag] = validate_config(disp, encoder, hevc) >= 0;
+        encoder.hevc[flag] = results[1] >= 0;
       }
     }
 
@@ -1898,8 +3222,156 @@ namespace video {
     return true;
   }
 
-  int
-  init() {
+  /**
+   * Version of the GPU drivers, as far as it can be found without loading them.
+   * On Linux, the in-tree drivers follow the kernel version.
+   */
+  static std::string
+  driver_version() {
+    std::string version;
+
+#ifdef __linux__
+    utsname name;
+    if (!uname(&name)) {
+      version = name.release;
+    }
+
+    std::ifstream nvidia { "/sys/module/nvidia/version" };
+    std::string nvidia_version;
+    if (std::getline(nvidia, nvidia_version)) {
+      version += ' ';
+      version += nvidia_version;
+    }
+#endif
+
+    return version;
+  }
+
+  /**
+   * Everything that could change the result of validate_encoder()
+   */
+  static std::string
+  probe_cache_key() {
+    std::ifstream config_file { config::sunshine.config_file };
+    std::string config_content { std::istreambuf_iterator<char>(config_file), std::istreambuf_iterator<char>() };
+
+    std::stringstream ss;
+    ss << PROJECT_VER << ';'
+       << av_version_info() << ';'
+       << avcodec_version() << ';'
+       << platf::gpu_identity() << ';'
+       << driver_version() << ';'
+       << config::sunshine.flags.to_string() << ';'
+       << std::hash<std::string> {}(config_content);
+
+    return ss.str();
+  }
+
+  /**
+   * Probing the encoders takes seconds, so the capabilities of those that passed are kept in config::video.encoder_cache.
+   * They're reused as long as probe_cache_key() doesn't change.
+   * Failures aren't kept, a driver or a display that wasn't ready yet shouldn't rule out an encoder for good.
+   *
+   * return true if the encoder passed validation with the same key
+   */
+  static bool
+  load_probe(encoder_t &encoder, const std::string &key) {
+    namespace pt = boost::property_tree;
+
+    pt::ptree tree;
+    try {
+      pt::read_json(config::video.encoder_cache, tree);
+
+      if (tree.get<std::string>("key") != key) {
+        return false;
+      }
+
+      auto &cached = tree.get_child(pt::ptree::path_type { "encoders/"s + std::string { encoder.name }, '/' });
+
+      // Caches written by older versions may still hold failures
+      if (!cached.get<bool>("passed")) {
+        return false;
+      }
+
+      auto h264 = cached.get<std::string>("h264");
+      auto hevc = cached.get<std::string>("hevc");
+      if (h264.size() != encoder_t::MAX_FLAGS || hevc.size() != encoder_t::MAX_FLAGS) {
+        return false;
+      }
+
+      encoder.h264.capabilities = std::bitset<encoder_t::MAX_FLAGS> { h264 };
+      encoder.hevc.capabilities = std::bitset<encoder_t::MAX_FLAGS> { hevc };
+
+      return true;
+    }
+    catch (std::exception &e) {
+      return false;
+    }
+  }
+
+  /**
+   * Keep the capabilities of an encoder that passed, forget those of one that no longer does
+   */
+  static void
+  store_probe(const encoder_t &encoder, const std::string &key, bool passed) {
+    namespace pt = boost::property_tree;
+
+    pt::ptree tree;
+    try {
+      pt::read_json(config::video.encoder_cache, tree);
+    }
+    catch (std::exception &e) {
+    }
+
+    // Results obtained with another key are out of date
+    if (tree.get("key", ""s) != key) {
+      tree.clear();
+      tree.put("key", key);
+    }
+
+    if (passed) {
+      pt::ptree cached;
+      cached.put("passed", true);
+      cached.put("h264", encoder.h264.capabilities.to_string());
+      cached.put("hevc", encoder.hevc.capabilities.to_string());
+
+      tree.put_child(pt::ptree::path_type { "encoders/"s + std::string { encoder.name }, '/' }, cached);
+    }
+    else if (auto encoders = tree.get_child_optional("encoders")) {
+      encoders->erase(std::string { encoder.name });
+    }
+
+    try {
+      pt::write_json(config::video.encoder_cache, tree);
+    }
+    catch (std::exception &e) {
+      BOOST_LOG(warning) << "Couldn't write encoder cache ["sv << config::video.encoder_cache << "]: "sv << e.what();
+    }
+  }
+
+  /**
+   * validate_encoder(), unless the encoder passed it before
+   */
+  static bool
+  probe_encoder(encoder_t &encoder, bool use_cache) {
+    static const auto key = probe_cache_key();
+
+    if (use_cache && load_probe(encoder, key)) {
+      BOOST_LOG(info) << "Encoder ["sv << encoder.name << "] passed previously, skipping validation"sv;
+      return true;
+    }
+
+    auto passed = validate_encoder(encoder);
+    store_probe(encoder, key, passed);
+
+    return passed;
+  }
+
+  /**
+   * Keep the encoders that passed validation, the first one is used.
+   */
+  static void
+  find_encoder(bool use_cache) {
     bool encoder_found = false;
     if (!config::video.encoder.empty()) {
       // If there is a specific encoder specified, use it if it passes validation
@@ -1908,7 +3380,7 @@ namespace video {
 
         if (encoder.name == config::video.encoder) {
           // Remove the encoder from the list entirely if it fails validation
-          if (!validate_encoder(encoder)) {
+          if (!probe_encoder(encoder, use_cache)) {
             pos = encoders.erase(pos);
             break;
           }
@@ -1942,7 +3414,7 @@ namespace video {
         auto encoder = *pos;
 
         // Remove the encoder from the list entirely if it fails validation
-        if (!validate_encoder(encoder)) {
+        if (!probe_encoder(encoder, use_cache)) {
           pos = encoders.erase(pos);
           continue;
         }
@@ -1968,7 +3440,7 @@ namespace video {
     // the remaining encoders until we find one that passes validation.
     if (!encoder_found) {
       KITTY_WHILE_LOOP(auto pos = std::begin(encoders), pos != std::end(encoders), {
-        if (!validate_encoder(*pos)) {
+        if (!probe_encoder(*pos, use_cache)) {
           pos = encoders.erase(pos);
           continue;
         }
@@ -1977,6 +3449,26 @@ namespace video {
       });
     }
 
+  }
+
+  int
+  init() {
+    // Cached results may be wrong, e.g. no display was available the last time around
+    auto candidates = encoders;
+    auto encoder_name = config::video.encoder;
+    auto hevc_mode = config::video.hevc_mode;
+
+    find_encoder(true);
+    if (encoders.empty()) {
+      BOOST_LOG(info) << "Validating the encoders again, ignoring the cache"sv;
+
+      encoders = std::move(candidates);
+      config::video.encoder = std::move(encoder_name);
+      config::video.hevc_mode = hevc_mode;
+
+      find_encoder(false);
+    }
+
     if (encoders.empty()) {
       BOOST_LOG(fatal) << "Couldn't find any working encoder"sv;
       return -1;
@@ -2016,6 +3508,29 @@ namespace video {
     return 0;
   }
 
+  static std::shared_future<int> init_result;
+
+  void
+  init_async() {
+    init_result = std::async(std::launch::async, []() {
+      auto ret = init();
+      if (ret) {
+        BOOST_LOG(error) << "Video failed to initialize"sv;
+      }
+
+      return ret;
+    }).share();
+  }
+
+  int
+  wait_for_init() {
+    if (!init_result.valid()) {
+      return -1;
+    }
+
+    return init_result.get();
+  }
+
   int
   hwframe_ctx(ctx_t &ctx, platf::hwdevice_t *hwdevice, buffer_t &hwdevice_ctx, AVPixelFormat format) {
     buffer_t frame_ref { av_hwframe_ctx_alloc(hwdevice_ctx.get()) };
@@ -2183,34 +3698,4 @@ namespace video {
 
     return platf::pix_fmt_e::unknown;
   }
-
-  color_t
-  make_color_matrix(float Cr, float Cb, const float2 &range_Y, const float2 &range_UV) {
-    float Cg = 1.0f - Cr - Cb;
-
-    float Cr_i = 1.0f - Cr;
-    float Cb_i = 1.0f - Cb;
-
-    float shift_y = range_Y[0] / 255.0f;
-    float shift_uv = range_UV[0] / 255.0f;
-
-    float scale_y = (range_Y[1] - range_Y[0]) / 255.0f;
-    float scale_uv = (range_UV[1] - range_UV[0]) / 255.0f;
-    return {
-      { Cr, Cg, Cb, 0.0f },
-      { -(Cr * 0.5f / Cb_i), -(Cg * 0.5f / Cb_i), 0.5f, 0.5f },
-      { 0.5f, -(Cg * 0.5f / Cr_i), -(Cb * 0.5f / Cr_i), 0.5f },
-      { scale_y, shift_y },
-      { scale_uv, shift_uv },
-    };
-  }
-
-  color_t colors[] {
-    make_color_matrix(0.299f, 0.114f, { 16.0f, 235.0f }, { 16.0f, 240.0f }),  // BT601 MPEG
-    make_color_matrix(0.299f, 0.114f, { 0.0f, 255.0f }, { 0.0f, 255.0f }),  // BT601 JPEG
-    make_color_matrix(0.2126f, 0.0722f, { 16.0f, 235.0f }, { 16.0f, 240.0f }),  // BT709 MPEG
-    make_color_matrix(0.2126f, 0.0722f, { 0.0f, 255.0f }, { 0.0f, 255.0f }),  // BT709 JPEG
-    make_color_matrix(0.2627f, 0.0593f, { 16.0f, 235.0f }, { 16.0f, 240.0f }),  // BT2020 MPEG
-    make_color_matrix(0.2627f, 0.0593f, { 0.0f, 255.0f }, { 0.0f, 255.0f }),  // BT2020 JPEG
-  };
 }  // namespace video
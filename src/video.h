@@ -36,17 +36,18 @@ namespace video {
     }
 
     struct replace_t {
-      std::string_view old;
-      std::string_view _new;
+      std::string old;
+      std::string _new;
 
-      KITTY_DEFAULT_CONSTR_MOVE(replace_t)
-
-      replace_t(std::string_view old, std::string_view _new) noexcept:
-          old { std::move(old) }, _new { std::move(_new) } {}
+      replace_t(std::string_view old, std::string_view _new):
+          old { old }, _new { _new } {}
     };
 
+    // Packets may outlive the encoder session that produced them, e.g. in a queue or in the gop cache of a shared encoder
+    using replacements_t = std::shared_ptr<const std::vector<replace_t>>;
+
     AVPacket *av_packet;
-    std::vector<replace_t> *replacements;
+    replacements_t replacements;
     void *channel_data;
   };
 
@@ -98,6 +99,19 @@ namespace video {
 
   int
   init();
+
+  /**
+   * Run init() in the background, so the servers needn't wait for the encoders to be probed
+   */
+  void
+  init_async();
+
+  /**
+   * Wait for init_async() to finish
+   * return the result of init()
+   */
+  int
+  wait_for_init();
 }  // namespace video
 
 #endif  // SUNSHINE_VIDEO_H
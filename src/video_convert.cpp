@@ -0,0 +1,494 @@
+/**
+ * @file video_convert.cpp
+ */
+#include <algorithm>
+#include <cmath>
+
+#if defined(__x86_64__) || defined(__i386__)
+  #include <immintrin.h>
+#elif defined(__ARM_NEON)
+  #include <arm_neon.h>
+#endif
+
+#include "video.h"
+#include "video_convert.h"
+
+// The matrices are shared with the GPU shaders, they live here so the conversion links without the encoders
+namespace video {
+  static color_t
+  make_color_matrix(float Cr, float Cb, const float2 &range_Y, const float2 &range_UV) {
+    float Cg = 1.0f - Cr - Cb;
+
+    float Cr_i = 1.0f - Cr;
+    float Cb_i = 1.0f - Cb;
+
+    float shift_y = range_Y[0] / 255.0f;
+    float shift_uv = range_UV[0] / 255.0f;
+
+    float scale_y = (range_Y[1] - range_Y[0]) / 255.0f;
+    float scale_uv = (range_UV[1] - range_UV[0]) / 255.0f;
+    return {
+      { Cr, Cg, Cb, 0.0f },
+      { -(Cr * 0.5f / Cb_i), -(Cg * 0.5f / Cb_i), 0.5f, 0.5f },
+      { 0.5f, -(Cg * 0.5f / Cr_i), -(Cb * 0.5f / Cr_i), 0.5f },
+      { scale_y, shift_y },
+      { scale_uv, shift_uv },
+    };
+  }
+
+  color_t colors[] {
+    make_color_matrix(0.299f, 0.114f, { 16.0f, 235.0f }, { 16.0f, 240.0f }),  // BT601 MPEG
+    make_color_matrix(0.299f, 0.114f, { 0.0f, 255.0f }, { 0.0f, 255.0f }),  // BT601 JPEG
+    make_color_matrix(0.2126f, 0.0722f, { 16.0f, 235.0f }, { 16.0f, 240.0f }),  // BT709 MPEG
+    make_color_matrix(0.2126f, 0.0722f, { 0.0f, 255.0f }, { 0.0f, 255.0f }),  // BT709 JPEG
+    make_color_matrix(0.2627f, 0.0593f, { 16.0f, 235.0f }, { 16.0f, 240.0f }),  // BT2020 MPEG
+    make_color_matrix(0.2627f, 0.0593f, { 0.0f, 255.0f }, { 0.0f, 255.0f }),  // BT2020 JPEG
+  };
+}  // namespace video
+
+namespace video::convert {
+  constexpr bool
+  is_wide(format_e format) {
+    return format == format_e::p010 || format == format_e::yuv420p10;
+  }
+
+  constexpr bool
+  is_semi_planar(format_e format) {
+    return format == format_e::nv12 || format == format_e::p010;
+  }
+
+  // P010 keeps its 10 bits in the most significant bits
+  constexpr int
+  msb_shift(format_e format) {
+    return format == format_e::p010 ? 6 : 0;
+  }
+
+  constexpr int
+  max_value(format_e format) {
+    return is_wide(format) ? 1023 : 255;
+  }
+
+  coefficients_t
+  make_coefficients(const color_t &color, int bits) {
+    // color_t is normalized, pick the integer range the way FFmpeg does:
+    // full range uses every code, limited range is the 8-bit range shifted up
+    bool full_range = color.range_y[1] == 0.0f;
+    auto mul = full_range ? (float) ((1 << bits) - 1) : (float) (255 << (bits - 8));
+
+    auto scale_y = color.range_y[0];
+    auto shift_y = color.range_y[1];
+    auto scale_uv = color.range_uv[0];
+    auto shift_uv = color.range_uv[1];
+
+    coefficients_t coefficients;
+
+    // color_vec_* are in R, G, B order
+    for (int c = 0; c < 3; ++c) {
+      coefficients.y[c] = (std::int16_t) std::lround(color.color_vec_y[2 - c] * scale_y * mul / 255.0f * (1 << 13));
+      coefficients.u[c] = (std::int16_t) std::lround(color.color_vec_u[2 - c] * scale_uv * mul / 255.0f * (1 << 13));
+      coefficients.v[c] = (std::int16_t) std::lround(color.color_vec_v[2 - c] * scale_uv * mul / 255.0f * (1 << 13));
+    }
+
+    coefficients.y_offset = std::lround((color.color_vec_y[3] * scale_y + shift_y) * mul * (1 << 13)) + (1 << 12);
+    coefficients.u_offset = std::lround((color.color_vec_u[3] * scale_uv + shift_uv) * mul * (1 << 15)) + (1 << 14);
+    coefficients.v_offset = std::lround((color.color_vec_v[3] * scale_uv + shift_uv) * mul * (1 << 15)) + (1 << 14);
+
+    return coefficients;
+  }
+
+  template <format_e F>
+  static inline void
+  store_y(std::uint8_t *row, int x, int value) {
+    value = std::clamp(value, 0, max_value(F));
+
+    if constexpr (is_wide(F)) {
+      ((std::uint16_t *) row)[x] = value << msb_shift(F);
+    }
+    else {
+      row[x] = value;
+    }
+  }
+
+  template <format_e F>
+  static inline void
+  store_uv(std::uint8_t *const dst[3], const int dst_pitch[3], int cy, int cx, int u, int v) {
+    u = std::clamp(u, 0, max_value(F));
+    v = std::clamp(v, 0, max_value(F));
+
+    if constexpr (is_semi_planar(F)) {
+      auto row = dst[1] + cy * dst_pitch[1];
+
+      if constexpr (is_wide(F)) {
+        ((std::uint16_t *) row)[cx * 2] = u << msb_shift(F);
+        ((std::uint16_t *) row)[cx * 2 + 1] = v << msb_shift(F);
+      }
+      else {
+        row[cx * 2] = u;
+        row[cx * 2 + 1] = v;
+      }
+    }
+    else {
+      auto row_u = dst[1] + cy * dst_pitch[1];
+      auto row_v = dst[2] + cy * dst_pitch[2];
+
+      if constexpr (is_wide(F)) {
+        ((std::uint16_t *) row_u)[cx] = u;
+        ((std::uint16_t *) row_v)[cx] = v;
+      }
+      else {
+        row_u[cx] = u;
+        row_v[cx] = v;
+      }
+    }
+  }
+
+  /**
+   * Convert the columns [x_begin, width) of the image.
+   * The vectorized kernels use it for the columns that don't fill a whole vector.
+   */
+  template <format_e F>
+  static void
+  convert_columns(const coefficients_t &k, const std::uint8_t *src, int src_pitch, std::uint8_t *const dst[3], const int dst_pitch[3], int x_begin, int width, int height) {
+    auto luma = [&](const std::uint8_t *px) {
+      return (k.y[0] * px[0] + k.y[1] * px[1] + k.y[2] * px[2] + k.y_offset) >> 13;
+    };
+
+    for (int y = 0; y < height; y += 2) {
+      auto row0 = src + y * src_pitch;
+      auto row1 = y + 1 < height ? row0 + src_pitch : row0;
+
+      for (int x = x_begin; x < width; x += 2) {
+        auto x1 = std::min(x + 1, width - 1);
+
+        const std::uint8_t *px[4] {
+          row0 + x * 4, row0 + x1 * 4, row1 + x * 4, row1 + x1 * 4
+        };
+
+        store_y<F>(dst[0] + y * dst_pitch[0], x, luma(px[0]));
+        if (x1 != x) {
+          store_y<F>(dst[0] + y * dst_pitch[0], x1, luma(px[1]));
+        }
+
+        if (y + 1 < height) {
+          store_y<F>(dst[0] + (y + 1) * dst_pitch[0], x, luma(px[2]));
+          if (x1 != x) {
+            store_y<F>(dst[0] + (y + 1) * dst_pitch[0], x1, luma(px[3]));
+          }
+        }
+
+        int sum[3] {};
+        for (auto p : px) {
+          sum[0] += p[0];
+          sum[1] += p[1];
+          sum[2] += p[2];
+        }
+
+        auto u = (k.u[0] * sum[0] + k.u[1] * sum[1] + k.u[2] * sum[2] + k.u_offset) >> 15;
+        auto v = (k.v[0] * sum[0] + k.v[1] * sum[1] + k.v[2] * sum[2] + k.v_offset) >> 15;
+
+        store_uv<F>(dst, dst_pitch, y / 2, x / 2, u, v);
+      }
+    }
+  }
+
+  template <format_e F>
+  static void
+  convert_scalar(const coefficients_t &k, const std::uint8_t *src, int src_pitch, std::uint8_t *const dst[3], const int dst_pitch[3], int width, int height) {
+    convert_columns<F>(k, src, src_pitch, dst, dst_pitch, 0, width, height);
+  }
+
+#if defined(__x86_64__) || defined(__i386__)
+  __attribute__((target("avx2"))) static inline __m256i
+  coefficient_vector(const std::int16_t c[3]) {
+    return _mm256_setr_epi16(
+      c[0], c[1], c[2], 0, c[0], c[1], c[2], 0,
+      c[0], c[1], c[2], 0, c[0], c[1], c[2], 0);
+  }
+
+  /**
+   * lo, hi <-- 8 pixels unpacked to 16 bits, see convert_avx2()
+   * return the dot products of the 8 pixels with the coefficients, in pixel order
+   */
+  __attribute__((target("avx2"))) static inline __m256i
+  dot(__m256i lo, __m256i hi, __m256i coefficients) {
+    return _mm256_hadd_epi32(_mm256_madd_epi16(lo, coefficients), _mm256_madd_epi16(hi, coefficients));
+  }
+
+  __attribute__((target("avx2"))) static inline __m256i
+  luma_avx2(__m256i lo, __m256i hi, __m256i coefficients, __m256i offset) {
+    return _mm256_srai_epi32(_mm256_add_epi32(dot(lo, hi, coefficients), offset), 13);
+  }
+
+  /**
+   * a_lo, a_hi, b_lo, b_hi <-- 16 pixels, each the sum of two rows
+   * return the 8 chroma samples, in order
+   */
+  __attribute__((target("avx2"))) static inline __m256i
+  chroma_avx2(__m256i a_lo, __m256i a_hi, __m256i b_lo, __m256i b_hi, __m256i coefficients, __m256i offset) {
+    // Adding each pair of columns leaves the samples as 0, 1, 4, 5 | 2, 3, 6, 7
+    auto sum = _mm256_hadd_epi32(dot(a_lo, a_hi, coefficients), dot(b_lo, b_hi, coefficients));
+    sum = _mm256_permutevar8x32_epi32(sum, _mm256_setr_epi32(0, 1, 4, 5, 2, 3, 6, 7));
+
+    return _mm256_srai_epi32(_mm256_add_epi32(sum, offset), 15);
+  }
+
+  template <format_e F>
+  __attribute__((target("avx2"))) static inline void
+  store_y_avx2(std::uint8_t *row, int x, __m256i y_a, __m256i y_b) {
+    // 16 values in pixel order
+    auto y16 = _mm256_permute4x64_epi64(_mm256_packus_epi32(y_a, y_b), 0xD8);
+
+    if constexpr (is_wide(F)) {
+      y16 = _mm256_slli_epi16(_mm256_min_epu16(y16, _mm256_set1_epi16(max_value(F))), msb_shift(F));
+      _mm256_storeu_si256((__m256i *) ((std::uint16_t *) row + x), y16);
+    }
+    else {
+      auto y8 = _mm_packus_epi16(_mm256_castsi256_si128(y16), _mm256_extracti128_si256(y16, 1));
+      _mm_storeu_si128((__m128i *) (row + x), y8);
+    }
+  }
+
+  template <format_e F>
+  __attribute__((target("avx2"))) static inline void
+  store_uv_avx2(std::uint8_t *const dst[3], const int dst_pitch[3], int cy, int cx, __m256i u, __m256i v) {
+    // u0..u7 in the low half, v0..v7 in the high half
+    auto uv16 = _mm256_permute4x64_epi64(_mm256_packus_epi32(u, v), 0xD8);
+    if constexpr (is_wide(F)) {
+      uv16 = _mm256_min_epu16(uv16, _mm256_set1_epi16(max_value(F)));
+    }
+
+    auto u16 = _mm256_castsi256_si128(uv16);
+    auto v16 = _mm256_extracti128_si256(uv16, 1);
+
+    if constexpr (is_semi_planar(F)) {
+      auto row = dst[1] + cy * dst_pitch[1];
+
+      auto uv_lo = _mm_unpacklo_epi16(u16, v16);
+      auto uv_hi = _mm_unpackhi_epi16(u16, v16);
+
+      if constexpr (is_wide(F)) {
+        _mm_storeu_si128((__m128i *) ((std::uint16_t *) row + cx * 2), _mm_slli_epi16(uv_lo, msb_shift(F)));
+        _mm_storeu_si128((__m128i *) ((std::uint16_t *) row + cx * 2 + 8), _mm_slli_epi16(uv_hi, msb_shift(F)));
+      }
+      else {
+        _mm_storeu_si128((__m128i *) (row + cx * 2), _mm_packus_epi16(uv_lo, uv_hi));
+      }
+    }
+    else {
+      auto row_u = dst[1] + cy * dst_pitch[1];
+      auto row_v = dst[2] + cy * dst_pitch[2];
+
+      if constexpr (is_wide(F)) {
+        _mm_storeu_si128((__m128i *) ((std::uint16_t *) row_u + cx), u16);
+        _mm_storeu_si128((__m128i *) ((std::uint16_t *) row_v + cx), v16);
+      }
+      else {
+        _mm_storel_epi64((__m128i *) (row_u + cx), _mm_packus_epi16(u16, u16));
+        _mm_storel_epi64((__m128i *) (row_v + cx), _mm_packus_epi16(v16, v16));
+      }
+    }
+  }
+
+  /**
+   * 16 pixels of two rows at a time.
+   *
+   * Unpacking 8 BGR0 pixels to 16 bits gives pixels 0, 1 | 4, 5 in the low vector and 2, 3 | 6, 7 in the high one.
+   * madd + hadd of those yields the dot products back in pixel order.
+   */
+  template <format_e F>
+  __attribute__((target("avx2"))) static void
+  convert_avx2(const coefficients_t &k, const std::uint8_t *src, int src_pitch, std::uint8_t *const dst[3], const int dst_pitch[3], int width, int height) {
+    auto zero = _mm256_setzero_si256();
+
+    auto ky = coefficient_vector(k.y);
+    auto ku = coefficient_vector(k.u);
+    auto kv = coefficient_vector(k.v);
+
+    auto y_offset = _mm256_set1_epi32(k.y_offset);
+    auto u_offset = _mm256_set1_epi32(k.u_offset);
+    auto v_offset = _mm256_set1_epi32(k.v_offset);
+
+    auto simd_width = width & ~15;
+
+    for (int y = 0; y < height; y += 2) {
+      auto row0 = src + y * src_pitch;
+      auto row1 = y + 1 < height ? row0 + src_pitch : row0;
+
+      auto y_row0 = dst[0] + y * dst_pitch[0];
+      auto y_row1 = dst[0] + (y + 1) * dst_pitch[0];
+
+      for (int x = 0; x < simd_width; x += 16) {
+        auto a0 = _mm256_loadu_si256((const __m256i *) (row0 + x * 4));
+        auto b0 = _mm256_loadu_si256((const __m256i *) (row0 + x * 4 + 32));
+        auto a1 = _mm256_loadu_si256((const __m256i *) (row1 + x * 4));
+        auto b1 = _mm256_loadu_si256((const __m256i *) (row1 + x * 4 + 32));
+
+        auto a0_lo = _mm256_unpacklo_epi8(a0, zero);
+        auto a0_hi = _mm256_unpackhi_epi8(a0, zero);
+        auto b0_lo = _mm256_unpacklo_epi8(b0, zero);
+        auto b0_hi = _mm256_unpackhi_epi8(b0, zero);
+        auto a1_lo = _mm256_unpacklo_epi8(a1, zero);
+        auto a1_hi = _mm256_unpackhi_epi8(a1, zero);
+        auto b1_lo = _mm256_unpacklo_epi8(b1, zero);
+        auto b1_hi = _mm256_unpackhi_epi8(b1, zero);
+
+        store_y_avx2<F>(y_row0, x, luma_avx2(a0_lo, a0_hi, ky, y_offset), luma_avx2(b0_lo, b0_hi, ky, y_offset));
+        if (y + 1 < height) {
+          store_y_avx2<F>(y_row1, x, luma_avx2(a1_lo, a1_hi, ky, y_offset), luma_avx2(b1_lo, b1_hi, ky, y_offset));
+        }
+
+        auto a_lo = _mm256_add_epi16(a0_lo, a1_lo);
+        auto a_hi = _mm256_add_epi16(a0_hi, a1_hi);
+        auto b_lo = _mm256_add_epi16(b0_lo, b1_lo);
+        auto b_hi = _mm256_add_epi16(b0_hi, b1_hi);
+
+        store_uv_avx2<F>(dst, dst_pitch, y / 2, x / 2,
+          chroma_avx2(a_lo, a_hi, b_lo, b_hi, ku, u_offset),
+          chroma_avx2(a_lo, a_hi, b_lo, b_hi, kv, v_offset));
+      }
+    }
+
+    convert_columns<F>(k, src, src_pitch, dst, dst_pitch, simd_width, width, height);
+  }
+#elif defined(__ARM_NEON)
+  template <format_e F>
+  static inline void
+  store_y_neon(std::uint8_t *row, int x, uint16x8_t y16) {
+    if constexpr (is_wide(F)) {
+      y16 = vshlq_n_u16(vminq_u16(y16, vdupq_n_u16(max_value(F))), msb_shift(F));
+      vst1q_u16((std::uint16_t *) row + x, y16);
+    }
+    else {
+      vst1_u8(row + x, vqmovn_u16(y16));
+    }
+  }
+
+  /**
+   * 8 pixels of two rows at a time
+   */
+  template <format_e F>
+  static void
+  convert_neon(const coefficients_t &k, const std::uint8_t *src, int src_pitch, std::uint8_t *const dst[3], const int dst_pitch[3], int width, int height) {
+    auto simd_width = width & ~7;
+
+    auto luma = [&](const uint8x8x4_t &px) {
+      auto b = vreinterpretq_s16_u16(vmovl_u8(px.val[0]));
+      auto g = vreinterpretq_s16_u16(vmovl_u8(px.val[1]));
+      auto r = vreinterpretq_s16_u16(vmovl_u8(px.val[2]));
+
+      auto half = [&](int16x4_t b, int16x4_t g, int16x4_t r) {
+        auto acc = vdupq_n_s32(k.y_offset);
+        acc = vmlal_n_s16(acc, b, k.y[0]);
+        acc = vmlal_n_s16(acc, g, k.y[1]);
+        acc = vmlal_n_s16(acc, r, k.y[2]);
+
+        return vqmovun_s32(vshrq_n_s32(acc, 13));
+      };
+
+      return vcombine_u16(
+        half(vget_low_s16(b), vget_low_s16(g), vget_low_s16(r)),
+        half(vget_high_s16(b), vget_high_s16(g), vget_high_s16(r)));
+    };
+
+    for (int y = 0; y < height; y += 2) {
+      auto row0 = src + y * src_pitch;
+      auto row1 = y + 1 < height ? row0 + src_pitch : row0;
+
+      for (int x = 0; x < simd_width; x += 8) {
+        auto px0 = vld4_u8(row0 + x * 4);
+        auto px1 = vld4_u8(row1 + x * 4);
+
+        store_y_neon<F>(dst[0] + y * dst_pitch[0], x, luma(px0));
+        if (y + 1 < height) {
+          store_y_neon<F>(dst[0] + (y + 1) * dst_pitch[0], x, luma(px1));
+        }
+
+        // Sum the two rows, then each pair of columns
+        int32x4_t sum[3];
+        for (int c = 0; c < 3; ++c) {
+          sum[c] = vreinterpretq_s32_u32(vpaddlq_u16(vaddl_u8(px0.val[c], px1.val[c])));
+        }
+
+        auto chroma = [&](const std::int16_t *coefficients, std::int32_t offset) {
+          auto acc = vdupq_n_s32(offset);
+          acc = vmlaq_n_s32(acc, sum[0], coefficients[0]);
+          acc = vmlaq_n_s32(acc, sum[1], coefficients[1]);
+          acc = vmlaq_n_s32(acc, sum[2], coefficients[2]);
+
+          auto value = vqmovun_s32(vshrq_n_s32(acc, 15));
+          if constexpr (is_wide(F)) {
+            value = vmin_u16(value, vdup_n_u16(max_value(F)));
+          }
+
+          return value;
+        };
+
+        auto u = chroma(k.u, k.u_offset);
+        auto v = chroma(k.v, k.v_offset);
+
+        auto cy = y / 2;
+        auto cx = x / 2;
+        if constexpr (is_semi_planar(F)) {
+          auto row = dst[1] + cy * dst_pitch[1];
+          auto uv = vzip_u16(u, v);
+          auto uv16 = vcombine_u16(uv.val[0], uv.val[1]);
+
+          if constexpr (is_wide(F)) {
+            vst1q_u16((std::uint16_t *) row + cx * 2, vshlq_n_u16(uv16, msb_shift(F)));
+          }
+          else {
+            vst1_u8(row + cx * 2, vqmovn_u16(uv16));
+          }
+        }
+        else {
+          auto row_u = dst[1] + cy * dst_pitch[1];
+          auto row_v = dst[2] + cy * dst_pitch[2];
+
+          if constexpr (is_wide(F)) {
+            vst1_u16((std::uint16_t *) row_u + cx, u);
+            vst1_u16((std::uint16_t *) row_v + cx, v);
+          }
+          else {
+            auto uv8 = vqmovn_u16(vcombine_u16(u, v));
+            vst1_lane_u32((std::uint32_t *) (row_u + cx), vreinterpret_u32_u8(uv8), 0);
+            vst1_lane_u32((std::uint32_t *) (row_v + cx), vreinterpret_u32_u8(uv8), 1);
+          }
+        }
+      }
+    }
+
+    convert_columns<F>(k, src, src_pitch, dst, dst_pitch, simd_width, width, height);
+  }
+#endif
+
+  template <format_e F>
+  static kernel_t
+  select_kernel() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+      return convert_avx2<F>;
+    }
+#elif defined(__ARM_NEON)
+    return convert_neon<F>;
+#endif
+
+    return convert_scalar<F>;
+  }
+
+  kernel_t
+  kernel(format_e format) {
+    switch (format) {
+      case format_e::nv12:
+        return select_kernel<format_e::nv12>();
+      case format_e::yuv420p:
+        return select_kernel<format_e::yuv420p>();
+      case format_e::p010:
+        return select_kernel<format_e::p010>();
+      case format_e::yuv420p10:
+        return select_kernel<format_e::yuv420p10>();
+    }
+
+    return nullptr;
+  }
+}  // namespace video::convert
@@ -0,0 +1,58 @@
+/**
+ * @file video_convert.h
+ */
+#ifndef SUNSHINE_VIDEO_CONVERT_H
+#define SUNSHINE_VIDEO_CONVERT_H
+
+#include <cstdint>
+
+namespace video {
+  struct color_t;
+}
+
+/**
+ * Dedicated BGR0 --> YUV 4:2:0 conversion, for when the captured image doesn't need scaling.
+ * It uses the same matrices as the GPU shaders, see video::colors
+ */
+namespace video::convert {
+  enum class format_e {
+    nv12,
+    yuv420p,
+    p010,
+    yuv420p10,
+  };
+
+  /**
+   * The color matrix in fixed point, for a given output bit depth
+   */
+  struct coefficients_t {
+    // Q13, in B, G, R order to match BGR0
+    std::int16_t y[3];
+    std::int16_t u[3];
+    std::int16_t v[3];
+
+    // Q13 for luma, Q15 for chroma as chroma sums 4 pixels, rounding included
+    std::int32_t y_offset;
+    std::int32_t u_offset;
+    std::int32_t v_offset;
+  };
+
+  coefficients_t
+  make_coefficients(const color_t &color, int bits);
+
+  /**
+   * src <-- BGR0, height rows of width pixels
+   * dst <-- The planes of the destination, pointing at the row matching the first row of src
+   *
+   * height is expected to be even, unless it's the last band of the image.
+   */
+  using kernel_t = void (*)(const coefficients_t &coefficients,
+    const std::uint8_t *src, int src_pitch,
+    std::uint8_t *const dst[3], const int dst_pitch[3],
+    int width, int height);
+
+  kernel_t
+  kernel(format_e format);
+}  // namespace video::convert
+
+#endif
@@ -0,0 +1,435 @@
+/**
+ * @file tools/convert.cpp
+ * Compare the dedicated BGR0 --> YUV 4:2:0 kernels of video_convert.cpp against swscale,
+ * for every color matrix and output format swdevice_t may hand to them.
+ * With --bench, time the conversions swdevice_t runs at 1080p, 1440p and 4K instead.
+ *
+ * Usage: convert-check [width height] [--exact]
+ *        convert-check --bench [threads]
+ */
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <future>
+#include <random>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+extern "C" {
+#include <libavutil/frame.h>
+#include <libavutil/opt.h>
+#include <libswscale/swscale.h>
+}
+
+#include "src/utility.h"
+#include "src/video.h"
+#include "src/video_convert.h"
+
+using namespace std::literals;
+
+namespace convert_check {
+  void
+  free_frame(AVFrame *frame) {
+    av_frame_free(&frame);
+  }
+
+  using frame_t = util::safe_ptr<AVFrame, free_frame>;
+  using sws_t = util::safe_ptr<SwsContext, sws_freeContext>;
+
+  struct format_t {
+    std::string_view name;
+    AVPixelFormat av_format;
+    video::convert::format_e format;
+    int bits;
+  };
+
+  constexpr format_t formats[] {
+    { "nv12"sv, AV_PIX_FMT_NV12, video::convert::format_e::nv12, 8 },
+    { "yuv420p"sv, AV_PIX_FMT_YUV420P, video::convert::format_e::yuv420p, 8 },
+    { "p010"sv, AV_PIX_FMT_P010, video::convert::format_e::p010, 10 },
+    { "yuv420p10"sv, AV_PIX_FMT_YUV420P10, video::convert::format_e::yuv420p10, 10 },
+  };
+
+  struct colorspace_t {
+    std::string_view name;
+    int sws_colorspace;
+
+    // Index of the limited range matrix in video::colors, the full range one follows it
+    int color;
+  };
+
+  constexpr colorspace_t colorspaces[] {
+    { "BT.601"sv, SWS_CS_SMPTE170M, 0 },
+    { "BT.709"sv, SWS_CS_ITU709, 2 },
+    { "BT.2020"sv, SWS_CS_BT2020, 4 },
+  };
+
+  struct diff_t {
+    int max = 0;
+    std::int64_t off = 0;
+    std::int64_t samples = 0;
+  };
+
+  /**
+   * Noise covers every code value and the rounding of the chroma average
+   */
+  std::vector<std::uint8_t>
+  make_image(int width, int height) {
+    std::vector<std::uint8_t> img((std::size_t) width * height * 4);
+
+    std::mt19937 random { 0 };
+    for (auto &byte : img) {
+      byte = random();
+    }
+
+    return img;
+  }
+
+  /**
+   * A BGR0 frame borrowing img, as swdevice_t::scale() passes the captured image to swscale
+   */
+  frame_t
+  wrap_image(std::vector<std::uint8_t> &img, int width, int height) {
+    frame_t frame { av_frame_alloc() };
+
+    frame->buf[0] = av_buffer_create(img.data(), img.size(), [](void *, std::uint8_t *) {}, nullptr, AV_BUFFER_FLAG_READONLY);
+    frame->data[0] = img.data();
+    frame->linesize[0] = width * 4;
+    frame->width = width;
+    frame->height = height;
+    frame->format = AV_PIX_FMT_BGR0;
+
+    return frame;
+  }
+
+  frame_t
+  make_frame(int width, int height, AVPixelFormat format) {
+    frame_t frame { av_frame_alloc() };
+
+    frame->width = width;
+    frame->height = height;
+    frame->format = format;
+
+    if (av_frame_get_buffer(frame.get(), 0)) {
+      return nullptr;
+    }
+
+    return frame;
+  }
+
+  /**
+   * The reference: swscale with the colorspace details swdevice_t sets, and exact arithmetic so only the rounding
+   * of the kernels shows up. The kernels average each 2x2 block for chroma, which is what area filtering does.
+   * Bilinear filtering spreads the chroma of a pixel over the neighbouring samples as well.
+   */
+  sws_t
+  make_sws(int width, int height, AVPixelFormat format, int colorspace, bool full_range) {
+    sws_t sws { sws_alloc_context() };
+    if (!sws) {
+      return nullptr;
+    }
+
+    av_opt_set_int(sws.get(), "srcw", width, 0);
+    av_opt_set_int(sws.get(), "srch", height, 0);
+    av_opt_set_int(sws.get(), "src_format", AV_PIX_FMT_BGR0, 0);
+    av_opt_set_int(sws.get(), "dstw", width, 0);
+    av_opt_set_int(sws.get(), "dsth", height, 0);
+    av_opt_set_int(sws.get(), "dst_format", format, 0);
+    av_opt_set_int(sws.get(), "sws_flags", SWS_AREA | SWS_ACCURATE_RND | SWS_BITEXACT | SWS_FULL_CHR_H_INP, 0);
+
+    // Chroma sits in the center of the 2x2 block it averages
+    av_opt_set_int(sws.get(), "src_h_chr_pos", 0, 0);
+    av_opt_set_int(sws.get(), "src_v_chr_pos", 0, 0);
+    av_opt_set_int(sws.get(), "dst_h_chr_pos", 128, 0);
+    av_opt_set_int(sws.get(), "dst_v_chr_pos", 128, 0);
+
+    if (sws_init_context(sws.get(), nullptr, nullptr) < 0) {
+      return nullptr;
+    }
+
+    sws_setColorspaceDetails(sws.get(),
+      sws_getCoefficients(SWS_CS_DEFAULT), 0,
+      sws_getCoefficients(colorspace), full_range,
+      0, 1 << 16, 1 << 16);
+
+    return sws;
+  }
+
+  /**
+   * samples <-- The number of samples in a row of the plane
+   */
+  void
+  compare_plane(diff_t &diff, const AVFrame *frame, const AVFrame *reference, int plane, int samples, int rows, const format_t &format) {
+    // P010 keeps its 10 bits in the most significant bits
+    auto shift = format.format == video::convert::format_e::p010 ? 6 : 0;
+
+    for (int y = 0; y < rows; ++y) {
+      auto row = frame->data[plane] + y * frame->linesize[plane];
+      auto row_ref = reference->data[plane] + y * reference->linesize[plane];
+
+      for (int x = 0; x < samples; ++x) {
+        int value, value_ref;
+        if (format.bits > 8) {
+          value = ((const std::uint16_t *) row)[x] >> shift;
+          value_ref = ((const std::uint16_t *) row_ref)[x] >> shift;
+        }
+        else {
+          value = row[x];
+          value_ref = row_ref[x];
+        }
+
+        auto delta = std::abs(value - value_ref);
+
+        diff.max = std::max(diff.max, delta);
+        diff.off += delta != 0;
+        ++diff.samples;
+      }
+    }
+  }
+
+  std::ostream &
+  operator<<(std::ostream &out, const diff_t &diff) {
+    return out << "max "sv << diff.max << " ("sv << std::fixed << std::setprecision(2)
+               << (double) diff.off * 100 / std::max<std::int64_t>(diff.samples, 1) << "% differ)"sv;
+  }
+
+  /**
+   * return true if the kernel stays within tolerance of swscale
+   */
+  bool
+  check(const std::vector<std::uint8_t> &img, int width, int height, const colorspace_t &colorspace, bool full_range, const format_t &format, int tolerance) {
+    auto frame = make_frame(width, height, format.av_format);
+    auto reference = make_frame(width, height, format.av_format);
+    auto sws = make_sws(width, height, format.av_format, colorspace.sws_colorspace, full_range);
+    if (!frame || !reference || !sws) {
+      std::cout << "Couldn't set up "sv << format.name << std::endl;
+      return false;
+    }
+
+    auto coefficients = video::convert::make_coefficients(video::colors[colorspace.color + full_range], format.bits);
+    video::convert::kernel(format.format)(coefficients, img.data(), width * 4, frame->data, frame->linesize, width, height);
+
+    auto data = img.data();
+    const int linesizes[2] {
+      width * 4, 0
+    };
+    sws_scale(sws.get(), &data, linesizes, 0, height, reference->data, reference->linesize);
+
+    bool semi_planar = format.format == video::convert::format_e::nv12 || format.format == video::convert::format_e::p010;
+    auto chroma_width = (width + 1) / 2;
+    auto chroma_height = (height + 1) / 2;
+
+    diff_t luma, chroma;
+    compare_plane(luma, frame.get(), reference.get(), 0, width, height, format);
+    if (semi_planar) {
+      compare_plane(chroma, frame.get(), reference.get(), 1, chroma_width * 2, chroma_height, format);
+    }
+    else {
+      compare_plane(chroma, frame.get(), reference.get(), 1, chroma_width, chroma_height, format);
+      compare_plane(chroma, frame.get(), reference.get(), 2, chroma_width, chroma_height, format);
+    }
+
+    bool passed = luma.max <= tolerance && chroma.max <= tolerance;
+
+    std::cout << std::left << std::setw(8) << colorspace.name << std::setw(5) << (full_range ? "JPEG"sv : "MPEG"sv) << ' '
+              << std::setw(10) << format.name << std::right
+              << " Y "sv << luma << ", UV "sv << chroma << (passed ? ""sv : " FAILED"sv) << std::endl;
+
+    return passed;
+  }
+
+  /**
+   * return the average time a call to f takes, in milliseconds
+   */
+  template <class F>
+  double
+  time_ms(F &&f) {
+    constexpr auto iterations = 50;
+
+    // Warm up the caches and the threads
+    f();
+
+    auto begin = std::chrono::steady_clock::now();
+    for (int x = 0; x < iterations; ++x) {
+      f();
+    }
+
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count() / iterations;
+  }
+
+  /**
+   * The swscale context of swdevice_t, for the default convert_quality
+   */
+  sws_t
+  make_scaler(int in_width, int in_height, int out_width, int out_height, int threads) {
+    sws_t sws { sws_alloc_context() };
+    if (!sws) {
+      return nullptr;
+    }
+
+    bool downscaling = out_width < in_width || out_height < in_height;
+
+    av_opt_set_int(sws.get(), "srcw", in_width, 0);
+    av_opt_set_int(sws.get(), "srch", in_height, 0);
+    av_opt_set_int(sws.get(), "src_format", AV_PIX_FMT_BGR0, 0);
+    av_opt_set_int(sws.get(), "dstw", out_width, 0);
+    av_opt_set_int(sws.get(), "dsth", out_height, 0);
+    av_opt_set_int(sws.get(), "dst_format", AV_PIX_FMT_NV12, 0);
+    av_opt_set_int(sws.get(), "sws_flags", downscaling ? SWS_LANCZOS : SWS_BILINEAR, 0);
+    av_opt_set_int(sws.get(), "threads", threads, 0);
+
+    if (sws_init_context(sws.get(), nullptr, nullptr) < 0) {
+      return nullptr;
+    }
+
+    return sws;
+  }
+
+  /**
+   * Time the conversion to NV12, the format most encoders take, with and without threads
+   */
+  bool
+  bench(int threads) {
+    constexpr std::pair<int, int> sizes[] {
+      { 1920, 1080 }, { 2560, 1440 }, { 3840, 2160 }
+    };
+
+    auto coefficients = video::convert::make_coefficients(video::colors[2], 8);
+    auto kernel = video::convert::kernel(video::convert::format_e::nv12);
+
+    std::cout << std::fixed << std::setprecision(2) << "Milliseconds per frame, 1 and "sv << threads << " threads:"sv << std::endl;
+
+    for (auto [width, height] : sizes) {
+      auto img = make_image(width, height);
+      auto src = wrap_image(img, width, height);
+      auto frame = make_frame(width, height, AV_PIX_FMT_NV12);
+      auto scaled = make_frame(1920, 1080, AV_PIX_FMT_NV12);
+      if (!src->buf[0] || !frame || !scaled) {
+        std::cout << "Couldn't allocate the frames"sv << std::endl;
+        return false;
+      }
+
+      // Split on even rows, like swdevice_t, with the calling thread converting the first band
+      auto convert_bands = [&](int band_count) {
+        auto units = height / 2;
+
+        auto convert_band = [&](int x) {
+          auto y = x * units / band_count * 2;
+          auto end = x + 1 == band_count ? height : (x + 1) * units / band_count * 2;
+
+          std::uint8_t *data[3] {
+            frame->data[0] + y * frame->linesize[0],
+            frame->data[1] + y / 2 * frame->linesize[1],
+            nullptr
+          };
+
+          kernel(coefficients, img.data() + (std::size_t) y * width * 4, width * 4, data, frame->linesize, width, end - y);
+        };
+
+        std::vector<std::future<void>> pending;
+        for (int x = 1; x < band_count; ++x) {
+          pending.emplace_back(std::async(std::launch::async, convert_band, x));
+        }
+
+        convert_band(0);
+        for (auto &future : pending) {
+          future.get();
+        }
+      };
+
+      std::cout << width << 'x' << height << ':' << std::endl;
+      std::cout << "  kernel             "sv << std::setw(6) << time_ms([&]() { convert_bands(1); })
+                << std::setw(8) << time_ms([&]() { convert_bands(threads); }) << std::endl;
+
+      auto sws_single = make_scaler(width, height, width, height, 1);
+      auto sws_threaded = make_scaler(width, height, width, height, threads);
+      if (!sws_single || !sws_threaded) {
+        std::cout << "Couldn't set up swscale"sv << std::endl;
+        return false;
+      }
+
+      std::cout << "  swscale bilinear   "sv << std::setw(6) << time_ms([&]() { sws_scale_frame(sws_single.get(), frame.get(), src.get()); })
+                << std::setw(8) << time_ms([&]() { sws_scale_frame(sws_threaded.get(), frame.get(), src.get()); }) << std::endl;
+
+      if (height <= 1080) {
+        continue;
+      }
+
+      sws_single = make_scaler(width, height, 1920, 1080, 1);
+      sws_threaded = make_scaler(width, height, 1920, 1080, threads);
+      if (!sws_single || !sws_threaded) {
+        std::cout << "Couldn't set up swscale"sv << std::endl;
+        return false;
+      }
+
+      std::cout << "  to 1080p, lanczos  "sv << std::setw(6) << time_ms([&]() { sws_scale_frame(sws_single.get(), scaled.get(), src.get()); })
+                << std::setw(8) << time_ms([&]() { sws_scale_frame(sws_threaded.get(), scaled.get(), src.get()); }) << std::endl;
+    }
+
+    return true;
+  }
+}  // namespace convert_check
+
+int
+main(int argc, char *argv[]) {
+  using namespace convert_check;
+
+  int tolerance = 1;
+  std::vector<std::pair<int, int>> sizes;
+
+  std::vector<std::string_view> args { argv + 1, argv + argc };
+  if (!args.empty() && args.front() == "--bench"sv) {
+    // The default of convert_threads for 1080p
+    auto cores = std::max(std::thread::hardware_concurrency(), 1u);
+    auto threads = args.size() > 1 ? std::atoi(args[1].data()) : (int) std::min({ std::max(cores / 2, 1u) + 1, cores, 4u });
+
+    return bench(std::max(threads, 1)) ? 0 : 1;
+  }
+
+  for (auto it = std::begin(args); it != std::end(args); ++it) {
+    if (*it == "--exact"sv) {
+      tolerance = 0;
+    }
+    else if (std::next(it) != std::end(args)) {
+      sizes.emplace_back(std::atoi(it->data()), std::atoi(std::next(it)->data()));
+      ++it;
+    }
+    else {
+      std::cout << "Usage: "sv << argv[0] << " [width height] [--exact]"sv << std::endl;
+      std::cout << "       "sv << argv[0] << " --bench [threads]"sv << std::endl;
+      return 2;
+    }
+  }
+
+  if (sizes.empty()) {
+    // 1366 leaves an odd number of chroma samples, so the vectorized kernels take their scalar tail
+    sizes = { { 1920, 1080 }, { 1366, 768 } };
+  }
+
+  bool passed = true;
+  for (auto [width, height] : sizes) {
+    if (width <= 0 || height <= 0) {
+      std::cout << "Invalid size "sv << width << 'x' << height << std::endl;
+      return 2;
+    }
+
+    std::cout << width << 'x' << height << ", tolerance "sv << tolerance << ':' << std::endl;
+
+    auto img = make_image(width, height);
+
+    for (auto &colorspace : colorspaces) {
+      for (auto full_range : { false, true }) {
+        for (auto &format : formats) {
+          passed = check(img, width, height, colorspace, full_range, format, tolerance) && passed;
+        }
+      }
+    }
+  }
+
+  return passed ? 0 : 1;
+}